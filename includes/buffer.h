@@ -8,64 +8,627 @@
 #include <linux/cdev.h>
 #include <linux/fs.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/list.h>
 #include <linux/uaccess.h>
 #include <linux/wait.h>
 #include <linux/sched.h>
+#include <linux/atomic.h>
+#include <linux/wait_bit.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include <linux/idr.h>
+#include <linux/poll.h>
+#include <linux/vmalloc.h>
+#include <linux/percpu.h>
+#include <linux/percpu-rwsem.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
+#include <linux/nodemask.h>
+#include <linux/numa.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
 
 #include "configuration.h"
 #include "ioctl_command.h"
 #include "macros.h"
+#include "ring.h"
+
+
+// * _ DEFINES _________________________________________________________________
+
+// Path taken by fifo_read_lock() and fifo_write_lock(), to give back to the 
+// matching unlock function. 
+#define FIFO_LOCK_FAST      0
+#define FIFO_LOCK_MUTEX     1
+
+// Returned by the read path instead of a side once the device is sharded, its 
+// messages are then read from the rings of each CPU. 
+#define FIFO_LOCK_SHARDED   2
+
+// Size of the length header stored before each message in record mode. 
+#define FIFO_RECORD_HEADER  RING_RECORD_HEADER
+
+// Size of the header stored before each message of a sharded FIFO: its 
+// length, then the time it was written in nanoseconds. 
+#define FIFO_SHARD_HEADER   (RING_RECORD_HEADER + sizeof(u64))
+
+// Number of buckets of the wait latency histogram: bucket i counts the waits 
+// of 2^i to 2^(i+1) microseconds, the first and last buckets are open-ended. 
+#define FIFO_HIST_BUCKETS   16
+
+// Add to a statistic counter of a FIFO, on the counters of the current CPU. 
+#define FIFO_COUNT(fifo, field, n) this_cpu_add((fifo)->stats->field, (n))
+
+// wait_event_interruptible() on a wait queue of a FIFO, accounting the time 
+// spent waiting in its statistics. 
+#define FIFO_WAIT_EVENT(fifo, wq, condition)                                \
+({                                                                          \
+    u64 __start = ktime_get_ns();                                           \
+    int __ret = wait_event_interruptible(wq, condition);                    \
+    fifo_count_wait(fifo, __start);                                         \
+    __ret;                                                                  \
+})
+
+// Remember the CPU the current reader or writer of a FIFO runs on in field, 
+// only writing it when it changed so a side staying put keeps its line clean. 
+#define FIFO_NOTE_CPU(fifo, field)                                          \
+do {                                                                        \
+    int __cpu = raw_smp_processor_id();                                     \
+    if (READ_ONCE((fifo)->field) != __cpu)                                  \
+        WRITE_ONCE((fifo)->field, __cpu);                                   \
+} while (0)
+
+// Same as FIFO_WAIT_EVENT, with an exclusive wait: a wake up only wakes one 
+// waiter of the queue, after every non-exclusive one like the pollers. 
+#define FIFO_WAIT_EVENT_EXCLUSIVE(fifo, wq, condition)                      \
+({                                                                          \
+    u64 __start = ktime_get_ns();                                           \
+    int __ret = wait_event_interruptible_exclusive(wq, condition);          \
+    fifo_count_wait(fifo, __start);                                         \
+    __ret;                                                                  \
+})
 
 
 // * _ STRUCTURE DEFINITIONS ___________________________________________________
 
+/// @brief Statistics of a FIFO, kept per CPU so counting never shares a cache 
+/// line, and summed when read. empty and full count the reads and writes that 
+/// found no data or no space, contended the mutexes found already taken and 
+/// blocked_ns the time spent sleeping for data or space. dropped and 
+/// dropped_msgs count the bytes and the messages overwritten before being read. 
+typedef struct fifo_counters_t
+{
+    u64     r_bytes; 
+    u64     w_bytes; 
+    u64     r_ops; 
+    u64     w_ops; 
+    u64     empty; 
+    u64     full; 
+    u64     contended; 
+    u64     blocked_ns; 
+    u64     dropped; 
+    u64     dropped_msgs; 
+    u64     wait_hist[FIFO_HIST_BUCKETS]; 
+}   FIFO_counters_t; 
+
+
+/// @brief The ring of one CPU of a sharded FIFO. The writers running on that 
+/// CPU take w_mutex in turn, the reader of the device drains it through the 
+/// cursors of ctl like the main ring. buffer holds ctl.size bytes, it is 
+/// allocated by the first write, on the memory node of the CPU. Aligned so 
+/// the rings of two CPUs never share a cache line. 
+typedef struct fifo_shard_t
+{
+    FIFO_ring_t         ctl; 
+    unsigned char*      buffer; 
+    struct mutex        w_mutex; 
+}   ____cacheline_aligned_in_smp FIFO_shard_t; 
+
+
+/// @brief A FIFO device. 
+/// Each side (read and write) is owned by one caller at a time through its 
+/// r_owner/w_owner word: 0 when free, 1 when owned, 2 when owned and someone 
+/// waits for it. While a side has a single opener, the owner word is all it 
+/// takes. Its mutex is only used once a second opener appears. The reader only 
+/// writes r_cur and the writer only writes w_cur, each published with release 
+/// semantics and read by the other side with acquire semantics. 
+/// The cursors are free-running: they count the bytes read and written since 
+/// the last reset and are masked with mask (size - 1) to index the buffer, so 
+/// w_cur - r_cur is the used space even once they wrap around. The buffer, 
+/// its size and its mask only change while both sides are taken through 
+/// their mutex. 
+/// Readers and pollers waiting for data sleep on r_wait, writers and pollers 
+/// waiting for space sleep on w_wait. Stream writers wait there exclusively, 
+/// each wake up lets a single one through and a writer done with the FIFO 
+/// passes it on. Writers waiting for room for a whole message each wait for 
+/// their own size, so they are all woken. lowat and hiwat are the watermarks 
+/// in bytes of used space: writers are only woken once the used space dropped 
+/// to lowat, readers once it reached hiwat, or holds a message in record mode. 
+/// mode holds the FIFO_MODE_* flags, it only changes while the device is empty 
+/// and both sides are taken, so owning one side is enough to read it. In 
+/// record mode, every message is stored after a FIFO_RECORD_HEADER bytes 
+/// header holding its length, and read back whole. In overwrite mode, a writer 
+/// short of space moves r_cur past the oldest data with a compare and exchange 
+/// before reusing it, and readers consume with a compare and exchange too: a 
+/// reader whose bytes were overwritten while it copied them starts over. 
+/// Every open file reading the device is listed in readers, under 
+/// readers_lock. In broadcast mode, each one reads from its own cursor and 
+/// r_cur follows the slowest of them, so the space is only given back to the 
+/// writers once every reader went past it. A writer short of space drops the 
+/// readers more than max_lag bytes behind, unless max_lag is 0. 
+/// In sharded mode, writers don't take the write side: each message goes to 
+/// the ring of the CPU its writer runs on, in shards, under the read lock of 
+/// shard_sem. The reader drains the main ring first, then the shards in turn 
+/// from shard_next, or oldest message first in ordered mode. Resetting, 
+/// resizing or changing the mode takes shard_sem for writing, after both 
+/// sides. shards holds nr_cpu_ids rings, it is allocated the first time the 
+/// device enters sharded mode and kept until it is destroyed. 
+/// The cursors live in the ring control page, which processes can map next 
+/// to the buffer to read or write without system calls. mapped counts those 
+/// mappings, the buffer can't be replaced while it is mapped. A new mapping 
+/// is counted under map_lock, which resizing, moving the buffer and changing 
+/// the mode hold from their check of mapped until they are done. mmap runs 
+/// with the mmap lock taken, so map_lock is never held across a user copy, 
+/// unlike the side mutexes. 
+/// node is the NUMA node the buffer is allocated on, NUMA_NO_NODE to let the 
+/// allocator choose. r_cpu and w_cpu are the CPUs the last read and the last 
+/// write through a system call ran on, -1 until then. huge counts the bytes of 
+/// the buffer mapped through 2MB pages, counted when the buffer is allocated. 
+/// The fields only read once the device is set up come first, then the ones 
+/// the reader writes, the ones the writer writes and the wait queues each 
+/// start their own cache line, so a side taking its lock doesn't steal the 
+/// line of the other. 
+/// Devices are allocated on demand and registered in fifo_idr under their 
+/// minor. openers counts every open file on the device, it is protected by 
+/// fifo_idr_mutex so a device can only be destroyed once it is closed. 
 typedef struct fifo_t
 {
-    struct cdev     cdev; 
-    struct mutex    r_mutex; 
-    struct mutex    w_mutex; 
-    struct device*  class_device;
-    unsigned char*  buffer;
-    int             r_cur; 
-    int             w_cur; 
+    unsigned int          minor; 
+    unsigned char*        buffer;
+    unsigned int          size; 
+    unsigned int          mask; 
+    unsigned int          mode; 
+    unsigned int          lowat; 
+    unsigned int          hiwat; 
+    unsigned int          max_lag; 
+    int                   node; 
+    unsigned int          huge; 
+    FIFO_ring_t*          ring; 
+    FIFO_shard_t*         shards; 
+    FIFO_counters_t __percpu* stats; 
+    struct device*        class_device;
+    struct dentry*        debugfs; 
+
+    // Read side. 
+    atomic_t              r_owner ____cacheline_aligned_in_smp; 
+    atomic_t              r_openers; 
+    unsigned int          shard_next; 
+    int                   r_cpu; 
+    struct mutex          r_mutex; 
+
+    // Write side. 
+    atomic_t              w_owner ____cacheline_aligned_in_smp; 
+    atomic_t              w_openers; 
+    int                   w_cpu; 
+    struct mutex          w_mutex; 
+
+    wait_queue_head_t     r_wait ____cacheline_aligned_in_smp; 
+    wait_queue_head_t     w_wait; 
+    atomic_t              mapped; 
+    struct mutex          map_lock; 
+    int                   openers; 
+    spinlock_t            readers_lock; 
+    struct list_head      readers; 
+    struct percpu_rw_semaphore shard_sem; 
 }   FIFO_t; 
 
 
+/// @brief An open file of a FIFO device, attached to its private data. A 
+/// file open for reading is listed in the readers of its device through node. 
+/// In broadcast mode, r_cur is its own read cursor and dropped is set once a 
+/// writer left it behind, then its reads fail with -EPIPE until it is opened 
+/// again or the device reset. Only its reader moves r_cur, under the read side 
+/// and readers_lock, the writers only read it under readers_lock. pid is the 
+/// process that opened the file. 
+typedef struct fifo_file_t
+{
+    FIFO_t*             fifo; 
+    struct list_head    node; 
+    unsigned int        r_cur; 
+    bool                dropped; 
+    pid_t               pid; 
+}   FIFO_file_t; 
+
+
+/// @brief Consistent snapshot of a FIFO occupancy. 
+typedef struct fifo_stat_t
+{
+    unsigned int    used; 
+    unsigned int    free; 
+    unsigned int    capacity; 
+    unsigned int    r_pos; 
+    unsigned int    w_pos; 
+}   FIFO_stat_t; 
+
+
 // * _ EXTERN GLOBAL VARIABLE DEFINITION _______________________________________
 
 extern unsigned int             fifo_major; 
 extern struct class*            fifo_class; 
+extern struct idr               fifo_idr; 
+extern struct mutex             fifo_idr_mutex; 
 extern struct device_attribute  dev_attr_view;
 extern struct device_attribute  dev_attr_free;
 extern struct device_attribute  dev_attr_used;
-extern FIFO_t                   fifos[FIFO_DEV_COUNT]; 
+extern struct device_attribute  dev_attr_stat;
+extern struct device_attribute  dev_attr_stats;
+extern struct device_attribute  dev_attr_dropped;
+extern struct device_attribute  dev_attr_readers;
+extern struct device_attribute  dev_attr_shards;
+extern struct device_attribute  dev_attr_node;
+extern struct device_attribute  dev_attr_cpus;
+extern struct device_attribute  dev_attr_backing;
+extern struct dentry*           fifo_debugfs; 
+extern const struct file_operations fifo_hist_fops; 
+extern bool                     spsc_enabled; 
+extern bool                     overwrite; 
+extern bool                     huge_pages; 
+extern unsigned int             buffer_size; 
 
 
 // * _ FUNCTION DECLARATIONS ___________________________________________________
 
-/// @brief Initialize the FIFO_t structure. 
+/// @brief Initialize the FIFO_t structure, allocate its buffer and create 
+///        its sys/class device. 
 /// @param fifo  pointer to a fifo structure. 
 /// @param minor minor number that will correspond to that FIFO_t device. 
-/// @param fops  file operation linked to that FIFO_t structure. 
 /// @return 0 if no error occurred, negative otherwise. 
-int init_fifo(FIFO_t* fifo, unsigned int minor, struct file_operations* fops);
+int init_fifo(FIFO_t* fifo, unsigned int minor);
+
+
+/// @brief Allocate a new FIFO device and register it. 
+/// @param minor minor number wanted for the device, negative for the first 
+///              free one. 
+/// @return the minor of the new device, -EEXIST if the minor is taken, 
+///         -ENOSPC if no minor is left, negative otherwise. 
+int fifo_create(int minor); 
+
+
+/// @brief Unregister a FIFO device and free it. 
+/// @param minor minor number of the device to destroy. 
+/// @return 0 if no error occurred, -ENODEV if there is no such device, -EBUSY 
+///         if it is still open. 
+int fifo_destroy(unsigned int minor); 
+
+
+/// @brief Find a FIFO device and count a new opener on it. 
+/// @param minor minor number of the device. 
+/// @return the device, NULL if there is no such device. 
+FIFO_t* fifo_get(unsigned int minor); 
+
+
+/// @brief Drop an opener counted by fifo_get. 
+/// @param fifo pointer to a fifo structure. 
+void fifo_put(FIFO_t* fifo); 
+
+
+/// @brief Check a buffer size and round it up to the next power of two. 
+/// @param size requested size in bytes. 
+/// @return the size to use, 0 if it is out of the allowed bounds. 
+unsigned int fifo_round_size(unsigned int size); 
 
 
 /// @brief Reset the fifo buffer, empty it and reset read & write cursor 
 ///        position. 
-/// @param minor minor number of the fifo to reset. 
-int fifo_reset(unsigned int minor); 
+/// @param fifo pointer to the fifo to reset. 
+int fifo_reset(FIFO_t* fifo); 
+
+
+/// @brief Replace the buffer of an empty fifo by a new one of a given size. 
+/// @param fifo pointer to the fifo to resize. 
+/// @param size requested size in bytes, rounded up to a power of two. 
+/// @return the new size, -EINVAL if the size is out of bounds, -EBUSY if the 
+///         fifo holds data, -ENOMEM or -ERESTARTSYS otherwise. 
+int fifo_resize(FIFO_t* fifo, unsigned int size); 
+
+
+/// @brief Change the mode of an empty fifo. 
+/// @param fifo pointer to a fifo structure. 
+/// @param mode FIFO_MODE_* flags. 
+/// @return 0 if no error occurred, -EINVAL for an unknown flag, overwrite 
+///         mode with broadcast mode or sharded mode without record mode or 
+///         with any other mode, -EBUSY if the fifo holds data, -ENOMEM or 
+///         -ERESTARTSYS otherwise. 
+int fifo_set_mode(FIFO_t* fifo, unsigned int mode); 
+
+
+/// @brief Change the watermarks of a fifo, then wake up the readers and 
+///        writers they unblock. 
+/// @param fifo pointer to a fifo structure. 
+/// @param low  used space at or below which blocked writers are woken. 
+/// @param high used space at or above which blocked readers are woken. 
+/// @return 0 if no error occurred, -EINVAL if low is not below the buffer 
+///         size or high not between 1 and the buffer size, -ERESTARTSYS if 
+///         interrupted. 
+int fifo_set_watermarks(FIFO_t* fifo, unsigned int low, unsigned int high); 
+
+
+/// @brief Change the lag limit of the broadcast mode readers of a fifo, then 
+///        drop the readers already past it. 
+/// @param fifo    pointer to a fifo structure. 
+/// @param max_lag lag in bytes past which a writer short of space drops a 
+///                reader, 0 to never drop them. 
+void fifo_set_max_lag(FIFO_t* fifo, unsigned int max_lag); 
+
+
+/// @brief Move the buffer of a fifo to a NUMA node, with its content. The 
+///        control page stays where it is, it can be reached without owning 
+///        a side. 
+/// @param fifo pointer to a fifo structure. 
+/// @param node node to allocate the buffer on, NUMA_NO_NODE for any. 
+/// @return 0 if no error occurred, -EINVAL if the node is not online, -EBUSY 
+///         if the buffer is mapped or was resized meanwhile, -ENOMEM or 
+///         -ERESTARTSYS otherwise. 
+int fifo_set_node(FIFO_t* fifo, int node); 
+
+
+/// @brief Return the number of bytes the next read of a file can return: the 
+///        length of the next message in record mode, the used space 
+///        otherwise. 
+/// @param fifo pointer to a fifo structure. 
+/// @param file open file asking, for its cursor in broadcast mode. 
+/// @return the size in bytes, -EIO if the next header is corrupted, -EPIPE 
+///         if the reader was dropped, -ERESTARTSYS if interrupted. 
+int fifo_next_size(FIFO_t* fifo, FIFO_file_t* file); 
+
+
+/// @brief List a file open for reading in the readers of a fifo, starting at 
+///        the oldest data still stored. 
+/// @param fifo pointer to a fifo structure. 
+/// @param file open file to list. 
+void fifo_attach(FIFO_t* fifo, FIFO_file_t* file); 
+
+
+/// @brief Remove a file from the readers of a fifo. In broadcast mode, the 
+///        space only it was holding goes back to the writers. 
+/// @param fifo pointer to a fifo structure. 
+/// @param file open file listed by fifo_attach. 
+void fifo_detach(FIFO_t* fifo, FIFO_file_t* file); 
+
+
+/// @brief Return the read cursor a file reads from: its own in broadcast 
+///        mode, the one of the ring otherwise. 
+/// @param fifo pointer to a fifo structure. 
+/// @param file open file reading. 
+/// @return a pointer to the cursor. 
+unsigned int* fifo_read_cursor(FIFO_t* fifo, FIFO_file_t* file); 
+
+
+/// @brief Drop the broadcast mode readers lagging more than the lag limit 
+///        behind the write cursor, and give the space they held back to the 
+///        writers. 
+/// @param fifo pointer to a fifo structure. 
+/// @return true if the read cursor of the ring moved. 
+bool fifo_drop_readers(FIFO_t* fifo); 
+
+
+/// @brief Check whether a broadcast mode reader lags more than the lag limit 
+///        behind the write cursor, so a writer short of space would make room 
+///        by dropping it. Nothing is changed. 
+/// @param fifo pointer to a fifo structure. 
+/// @return true if the next write drops a reader. 
+bool fifo_readers_lagging(FIFO_t* fifo); 
+
+
+/// @brief Read the length of the message at the read cursor of a record 
+///        mode fifo, with the read side owned. 
+/// @param fifo  pointer to a fifo structure. 
+/// @param r_cur read cursor. 
+/// @param used  used space, not empty. 
+/// @return the message length, -EIO if the header is corrupted. 
+int fifo_record_length(FIFO_t* fifo, unsigned int r_cur, unsigned int used); 
+
+
+/// @brief Drop the oldest data of an overwrite mode fifo until len bytes fit 
+///        after the write cursor, with the write side owned. In record mode, 
+///        whole messages are dropped. 
+/// @param fifo  pointer to a fifo structure. 
+/// @param w_cur write cursor. 
+/// @param len   number of bytes needed after the write cursor. 
+/// @return 0 once they fit, -EMSGSIZE if len is larger than the buffer. 
+int fifo_overwrite(FIFO_t* fifo, unsigned int w_cur, size_t len); 
+
+
+/// @brief Move the read cursor of a file after a read, with the read side 
+///        owned. 
+/// @param fifo   pointer to a fifo structure. 
+/// @param file   open file reading. 
+/// @param r_cur  read cursor the read started from. 
+/// @param r_next read cursor after the bytes read. 
+/// @return 0 if the cursor moved, -EAGAIN if a writer in overwrite mode 
+///         dropped the bytes in the meantime, then the read must start over, 
+///         -EPIPE if a writer dropped the reader in broadcast mode. 
+int fifo_consume(FIFO_t* fifo, FIFO_file_t* file, unsigned int r_cur, unsigned int r_next); 
+
+
+/// @brief Copy bytes out of the ring, wrapping at the end of the buffer. 
+/// @param fifo pointer to a fifo structure. 
+/// @param cur  free-running cursor of the first byte. 
+/// @param dst  destination buffer. 
+/// @param len  number of bytes to copy, at most the buffer size. 
+void fifo_peek(FIFO_t* fifo, unsigned int cur, void* dst, unsigned int len); 
+
+
+/// @brief Copy bytes into the ring, wrapping at the end of the buffer. 
+/// @param fifo pointer to a fifo structure. 
+/// @param cur  free-running cursor of the first byte. 
+/// @param src  source buffer. 
+/// @param len  number of bytes to copy, at most the buffer size. 
+void fifo_poke(FIFO_t* fifo, unsigned int cur, const void* src, unsigned int len); 
+
+
+/// @brief Copy bytes out of the ring to user-space, wrapping at the end of 
+///        the buffer. 
+/// @param fifo pointer to a fifo structure. 
+/// @param cur  free-running cursor of the first byte. 
+/// @param dst  user-space destination. 
+/// @param len  number of bytes to copy, at most the buffer size. 
+/// @return 0 if no error occurred, -EFAULT otherwise. 
+int fifo_copy_to_user(FIFO_t* fifo, unsigned int cur, void __user* dst, unsigned int len); 
+
+
+/// @brief Copy bytes from user-space into the ring, wrapping at the end of 
+///        the buffer. 
+/// @param fifo pointer to a fifo structure. 
+/// @param cur  free-running cursor of the first byte. 
+/// @param src  user-space source. 
+/// @param len  number of bytes to copy, at most the buffer size. 
+/// @return 0 if no error occurred, -EFAULT otherwise. 
+int fifo_copy_from_user(FIFO_t* fifo, unsigned int cur, const void __user* src, unsigned int len); 
+
+
+/// @brief Map the control page and the buffer of a FIFO into a process. 
+/// @param fifo pointer to a fifo structure. 
+/// @param vma  shared mapping to fill, the control page at page offset 
+///             FIFO_MMAP_RING_PGOFF and the buffer from FIFO_MMAP_DATA_PGOFF. 
+/// @return 0 if no error occurred, -EINVAL if the mapping is not shared or 
+///         goes past the buffer, -ERESTARTSYS if interrupted. 
+int fifo_mmap_ring(FIFO_t* fifo, struct vm_area_struct* vma); 
+
+
+/// @brief Return the used space blocked readers wait for: the high watermark, 
+///        or a single byte in record mode since messages come whole. 
+/// @param fifo pointer to a fifo structure. 
+/// @return the threshold in bytes. 
+unsigned int fifo_read_threshold(FIFO_t* fifo); 
+
+
+/// @brief Check whether the used space reached the read threshold. 
+/// @param fifo pointer to a fifo structure. 
+/// @return true if blocked readers can be woken. 
+bool fifo_readable(FIFO_t* fifo); 
+
+
+/// @brief Return the number of bytes a file can read, from its own cursor in 
+///        broadcast mode. 
+/// @param fifo pointer to a fifo structure. 
+/// @param file open file reading. 
+/// @return the used space in bytes. 
+unsigned int fifo_file_used(FIFO_t* fifo, FIFO_file_t* file); 
+
+
+/// @brief Check whether a file can be woken up: the data it can read reached 
+///        the read threshold, or it was dropped. 
+/// @param fifo pointer to a fifo structure. 
+/// @param file open file reading. 
+/// @return true if a reader blocked on that file can go on. 
+bool fifo_file_readable(FIFO_t* fifo, FIFO_file_t* file); 
+
+
+/// @brief Check whether the used space dropped to the low watermark. 
+/// @param fifo pointer to a fifo structure. 
+/// @return true if blocked writers can be woken. 
+bool fifo_writable(FIFO_t* fifo); 
+
+
+/// @brief Wake up the readers and pollers waiting for data if the FIFO is 
+///        readable. The barrier in wq_has_sleeper() makes sure they see the 
+///        cursor moved before the call. 
+/// @param fifo pointer to a fifo structure. 
+void fifo_wake_readers(FIFO_t* fifo); 
+
+
+/// @brief Wake up the pollers and a single writer waiting for space if the 
+///        FIFO is writable. 
+/// @param fifo pointer to a fifo structure. 
+void fifo_wake_writers(FIFO_t* fifo); 
+
+
+/// @brief Wake up the readers and writers of a FIFO that can make progress, 
+///        after a process moved a cursor through the control page. 
+/// @param fifo pointer to a fifo structure. 
+void fifo_notify(FIFO_t* fifo); 
+
+
+/// @brief Take ownership of the read side of the FIFO. Without concurrent 
+///        readers, no mutex is taken. 
+/// @param fifo pointer to a fifo structure. 
+/// @return FIFO_LOCK_FAST or FIFO_LOCK_MUTEX to give back to fifo_read_unlock, 
+///         -ERESTARTSYS if a signal interrupted the wait. 
+int fifo_read_lock(FIFO_t* fifo); 
+
+
+/// @brief Take ownership of the read side of the FIFO without sleeping. 
+/// @param fifo pointer to a fifo structure. 
+/// @return FIFO_LOCK_FAST or FIFO_LOCK_MUTEX to give back to fifo_read_unlock, 
+///         -EAGAIN if another reader owns it. 
+int fifo_read_trylock(FIFO_t* fifo); 
+
+
+/// @brief Release the read side of the FIFO. 
+/// @param fifo pointer to a fifo structure. 
+/// @param lock value returned by fifo_read_lock. 
+void fifo_read_unlock(FIFO_t* fifo, int lock); 
+
+
+/// @brief Take ownership of the write side of the FIFO. Without concurrent 
+///        writers, no mutex is taken. 
+/// @param fifo pointer to a fifo structure. 
+/// @return FIFO_LOCK_FAST or FIFO_LOCK_MUTEX to give back to fifo_write_unlock, 
+///         -ERESTARTSYS if a signal interrupted the wait. 
+int fifo_write_lock(FIFO_t* fifo); 
+
+
+/// @brief Take ownership of the write side of the FIFO without sleeping. 
+/// @param fifo pointer to a fifo structure. 
+/// @return FIFO_LOCK_FAST or FIFO_LOCK_MUTEX to give back to 
+///         fifo_write_unlock, -EAGAIN if another writer owns it. 
+int fifo_write_trylock(FIFO_t* fifo); 
+
+
+/// @brief Release the write side of the FIFO. 
+/// @param fifo pointer to a fifo structure. 
+/// @param lock value returned by fifo_write_lock. 
+void fifo_write_unlock(FIFO_t* fifo, int lock); 
+
+
+/// @brief Take a snapshot of the occupancy of a FIFO in constant time. The 
+///        values are consistent with each other even while the FIFO is being 
+///        read and written. 
+/// @param fifo pointer to the fifo we want to check. 
+/// @param stat structure filled with the snapshot. 
+void fifo_get_stat(FIFO_t* fifo, FIFO_stat_t* stat); 
+
+
+/// @brief Account a wait for data or space in the statistics of a FIFO. 
+/// @param fifo  pointer to a fifo structure. 
+/// @param start ktime_get_ns() value taken before sleeping. 
+void fifo_count_wait(FIFO_t* fifo, u64 start); 
+
+
+/// @brief Sum the per CPU statistics of a FIFO. 
+/// @param fifo  pointer to a fifo structure. 
+/// @param total structure filled with the sums. 
+void fifo_get_counters(FIFO_t* fifo, FIFO_counters_t* total); 
+
+
+/// @brief Zero the statistics of a FIFO. Events counted at the same time on 
+///        other CPUs may be kept. 
+/// @param fifo pointer to a fifo structure. 
+void fifo_reset_counters(FIFO_t* fifo); 
 
 
 /// @brief Return the number of bytes available to write. 
-/// @param minor minor of the device we want to check. 
+/// @param fifo pointer to the fifo we want to check. 
 /// @return the free space in bytes. 
-int fifo_get_free_space(int minor); 
+unsigned int fifo_get_free_space(FIFO_t* fifo); 
 
 
 /// @brief Return the number of bytes used in the buffer. 
-/// @param minor minor of the device we want to check. 
+/// @param fifo pointer to the fifo we want to check. 
 /// @return the used space in bytes. 
-int fifo_get_used_space(int minor); 
+unsigned int fifo_get_used_space(FIFO_t* fifo); 
 
 #endif
\ No newline at end of file
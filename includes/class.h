@@ -7,6 +7,7 @@
 #include <linux/module.h>
 #include <linux/init.h>
 #include <linux/fs.h>
+#include <linux/seq_file.h>
 
 #include "configuration.h"
 #include "ioctl_command.h"
@@ -14,9 +15,13 @@
 #include "buffer.h"
 
 
-// * _ EXTERN GLOBAL VARIABLE DEFINITION _______________________________________
+// * _ DEFINES _________________________________________________________________
 
-extern FIFO_t   fifos[FIFO_DEV_COUNT]; 
+// Line closing a sys/class list cut short because the page is full. 
+#define FIFO_SYSFS_MORE "...\n"
+
+// Longest line of a sys/class list. 
+#define FIFO_SYSFS_LINE 64
 
 
 // * _ CLASS DEVICE FUNCTIONS __________________________________________________
@@ -48,4 +53,95 @@ ssize_t fifo_free_space_show(struct device *dev, struct device_attribute *attr,
 ssize_t fifo_used_space_show(struct device *dev, struct device_attribute *attr, char *buf); 
 
 
+/// @brief sys/class read function to shows, in one read, the used space, the 
+///        free space, the capacity of the buffer and the read and write cursor 
+///        positions. 
+/// @param dev  pointer to a device struct. 
+/// @param attr not used. 
+/// @param buf  buffer where we'll print the values, separated by spaces. 
+/// @return     the number of bytes printed into the sysfs file. 
+ssize_t fifo_stat_show(struct device *dev, struct device_attribute *attr, char *buf); 
+
+
+/// @brief sys/class read function to show, on a single line, the bytes read 
+///        and written, the read and write operations, the reads finding the 
+///        FIFO empty, the writes finding it full, the contended mutexes and 
+///        the time spent blocked in nanoseconds, since the last reset. 
+/// @param dev  pointer to a device struct. 
+/// @param attr not used. 
+/// @param buf  buffer where we'll print the statistics. 
+/// @return     the number of bytes printed into the sysfs file. 
+ssize_t fifo_stats_show(struct device *dev, struct device_attribute *attr, char *buf); 
+
+
+/// @brief sys/class read function to show the bytes and the messages dropped 
+///        by overwrite mode writes, since the last reset of the statistics. 
+/// @param dev  pointer to a device struct. 
+/// @param attr not used. 
+/// @param buf  buffer where we'll print both counts, separated by a space. 
+/// @return     the number of bytes printed into the sysfs file. 
+ssize_t fifo_dropped_show(struct device *dev, struct device_attribute *attr, char *buf); 
+
+
+/// @brief sys/class read function to show one line per open file reading the 
+///        device: the pid of the process that opened it and how many bytes it 
+///        is behind the writers, followed by "dropped" once a writer left it 
+///        behind in broadcast mode. The list ends with a "..." line when 
+///        the page can't hold every reader. 
+/// @param dev  pointer to a device struct. 
+/// @param attr not used. 
+/// @param buf  buffer where we'll print the readers. 
+/// @return     the number of bytes printed into the sysfs file. 
+ssize_t fifo_readers_show(struct device *dev, struct device_attribute *attr, char *buf); 
+
+
+/// @brief sys/class read function to show one line per CPU ring of a 
+///        sharded device: the CPU, its used space and its size in bytes. 
+///        Rings not allocated yet are not shown. The list ends with a "..." 
+///        line when the page can't hold every ring. 
+/// @param dev  pointer to a device struct. 
+/// @param attr not used. 
+/// @param buf  buffer where we'll print the rings. 
+/// @return     the number of bytes printed into the sysfs file. 
+ssize_t fifo_shards_show(struct device *dev, struct device_attribute *attr, char *buf); 
+
+
+/// @brief sys/class read function to show the NUMA node the buffer of the 
+///        device is allocated on, -1 if the allocator chose. 
+/// @param dev  pointer to a device struct. 
+/// @param attr not used. 
+/// @param buf  buffer where we'll print the node. 
+/// @return     the number of bytes printed into the sysfs file. 
+ssize_t fifo_node_show(struct device *dev, struct device_attribute *attr, char *buf); 
+
+
+/// @brief sys/class read function to show the CPU the last read ran on and 
+///        its node, then the CPU the last write ran on and its node, -1 
+///        before the first one. Writes to a sharded device are not counted, 
+///        they run on every CPU. 
+/// @param dev  pointer to a device struct. 
+/// @param attr not used. 
+/// @param buf  buffer where we'll print the CPUs. 
+/// @return     the number of bytes printed into the sysfs file. 
+ssize_t fifo_cpus_show(struct device *dev, struct device_attribute *attr, char *buf); 
+
+
+/// @brief sys/class read function to show the pages backing the buffer of 
+///        the device: huge when all of it is mapped through 2MB pages, 
+///        partial when only some of it is, small otherwise, followed by the 
+///        number of bytes mapped through 2MB pages and the buffer size. 
+/// @param dev  pointer to a device struct. 
+/// @param attr not used. 
+/// @param buf  buffer where we'll print the backing. 
+/// @return     the number of bytes printed into the sysfs file. 
+ssize_t fifo_backing_show(struct device *dev, struct device_attribute *attr, char *buf); 
+
+
+/// @brief open function of the debugfs wait latency histogram file. 
+/// @param inode pointer to the inode structure, its private data is the FIFO. 
+/// @param fp    pointer to the file structure. 
+/// @return      0 if no error occurred, negative otherwise. 
+int fifo_hist_open(struct inode* inode, struct file* fp); 
+
+
 #endif
\ No newline at end of file
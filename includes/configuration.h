@@ -26,13 +26,64 @@
 #endif
 
 
-// Defines the number of minors handled by the driver. 
+// Defines the number of devices created when the driver is loaded. More can be 
+// created and destroyed at runtime through /dev/fifo_ctl. 
 #define FIFO_DEV_COUNT          3
 
+// Defines the number of minors reserved for the devices. The control device 
+// uses the minor right after them. 
+#define FIFO_MAX_DEVICES        1024
+#define FIFO_CTL_MINOR          FIFO_MAX_DEVICES
 
-// Defines the total buffer size for each interface in bytes. 
+
+// Defines the default buffer size for each interface in bytes. Must be a power 
+// of two. Can be changed when loading the module with buffer_size=<bytes> and 
+// for each idle device with the IO_FIFO_SET_SIZE ioctl, other sizes are rounded 
+// up to the next power of two. 
 #define FIFO_BUFFER_SIZE        2048
 
+#if FIFO_BUFFER_SIZE & (FIFO_BUFFER_SIZE - 1)
+    #error "FIFO_BUFFER_SIZE must be a power of two."
+#endif
+
+// Defines the bounds of the buffer size in bytes. 
+#define FIFO_BUFFER_MIN_SIZE    64
+#define FIFO_BUFFER_MAX_SIZE    (256 * 1024 * 1024)
+
+
+// Defines the default watermarks of each interface. Blocked writers are woken 
+// once 1/FIFO_LOW_WATERMARK_DIV of the buffer is free rather than on every 
+// byte read, blocked readers once FIFO_HIGH_WATERMARK bytes are used. Both can 
+// be changed for each device with the IO_FIFO_SET_WATERMARKS ioctl, resizing a 
+// device sets them back to these defaults. 
+#define FIFO_LOW_WATERMARK_DIV  4
+#define FIFO_HIGH_WATERMARK     1
+
+
+// Makes the devices drop their oldest data instead of blocking writers when 
+// full, from their creation. Can be changed when loading the module with 
+// overwrite=0|1, and for each empty device with the IO_FIFO_SET_MODE ioctl. 
+#define FIFO_OVERWRITE          0
+
+
+// Defines the default lag limit of broadcast mode readers in bytes: a writer 
+// short of space drops the readers further behind. 0 never drops them, the 
+// writers wait for the slowest reader instead. Can be changed for each device 
+// with the IO_FIFO_SET_MAX_LAG ioctl. 
+#define FIFO_MAX_LAG            0
+
+
+// Backs the buffers of at least 2MB with 2MB pages when the architecture maps 
+// vmalloc memory that way, falling back to 4KB pages when none is free. Can be 
+// changed when loading the module with huge_pages=0|1, and takes effect on the 
+// next allocation of each buffer. 
+#define FIFO_HUGE_PAGES         0
+
+
+// Enables the lockless path taken while a FIFO has a single reader and a single 
+// writer. Can be changed when loading the module with spsc_enabled=0|1. 
+#define FIFO_SPSC_ENABLED       1
+
 
 // Define the number of element to show when printing a graphical representation 
 // of a fifo buffer.
@@ -0,0 +1,116 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM fifo
+
+#if !defined(_FIFO_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _FIFO_TRACE_H_
+
+#include <linux/tracepoint.h>
+
+
+// * _ TRACEPOINTS _____________________________________________________________
+// Found under /sys/kernel/tracing/events/fifo, they cost a single branch while 
+// disabled. The cursors are the free-running ones, not masked. 
+
+/// @brief Bytes moving in or out of a FIFO, or a writer blocking on it. 
+DECLARE_EVENT_CLASS(fifo_xfer,
+    TP_PROTO(unsigned int minor, size_t bytes, unsigned int r_cur, unsigned int w_cur),
+    TP_ARGS(minor, bytes, r_cur, w_cur),
+
+    TP_STRUCT__entry(
+        __field(unsigned int,   minor)
+        __field(size_t,         bytes)
+        __field(unsigned int,   r_cur)
+        __field(unsigned int,   w_cur)
+    ),
+
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->bytes = bytes;
+        __entry->r_cur = r_cur;
+        __entry->w_cur = w_cur;
+    ),
+
+    TP_printk(
+        "minor=%u bytes=%zu r_cur=%u w_cur=%u",
+        __entry->minor, __entry->bytes, __entry->r_cur, __entry->w_cur
+    )
+);
+
+/// @brief Bytes published by a writer, w_cur is the new write cursor. 
+DEFINE_EVENT(fifo_xfer, fifo_enqueue,
+    TP_PROTO(unsigned int minor, size_t bytes, unsigned int r_cur, unsigned int w_cur),
+    TP_ARGS(minor, bytes, r_cur, w_cur)
+);
+
+/// @brief Bytes consumed by a reader, r_cur is the new read cursor. 
+DEFINE_EVENT(fifo_xfer, fifo_dequeue,
+    TP_PROTO(unsigned int minor, size_t bytes, unsigned int r_cur, unsigned int w_cur),
+    TP_ARGS(minor, bytes, r_cur, w_cur)
+);
+
+/// @brief A writer goes to sleep, bytes is the space it waits for. 
+DEFINE_EVENT(fifo_xfer, fifo_writer_block,
+    TP_PROTO(unsigned int minor, size_t bytes, unsigned int r_cur, unsigned int w_cur),
+    TP_ARGS(minor, bytes, r_cur, w_cur)
+);
+
+/// @brief A writer woke up, bytes is the free space it found. 
+DEFINE_EVENT(fifo_xfer, fifo_writer_wake,
+    TP_PROTO(unsigned int minor, size_t bytes, unsigned int r_cur, unsigned int w_cur),
+    TP_ARGS(minor, bytes, r_cur, w_cur)
+);
+
+
+/// @brief A FIFO emptied by the reset ioctl. 
+TRACE_EVENT(fifo_reset,
+    TP_PROTO(unsigned int minor, unsigned int size),
+    TP_ARGS(minor, size),
+
+    TP_STRUCT__entry(
+        __field(unsigned int,   minor)
+        __field(unsigned int,   size)
+    ),
+
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->size = size;
+    ),
+
+    TP_printk("minor=%u size=%u", __entry->minor, __entry->size)
+);
+
+
+/// @brief A FIFO buffer replaced by the resize ioctl. 
+TRACE_EVENT(fifo_resize,
+    TP_PROTO(unsigned int minor, unsigned int old_size, unsigned int size),
+    TP_ARGS(minor, old_size, size),
+
+    TP_STRUCT__entry(
+        __field(unsigned int,   minor)
+        __field(unsigned int,   old_size)
+        __field(unsigned int,   size)
+    ),
+
+    TP_fast_assign(
+        __entry->minor = minor;
+        __entry->old_size = old_size;
+        __entry->size = size;
+    ),
+
+    TP_printk(
+        "minor=%u old_size=%u size=%u",
+        __entry->minor, __entry->old_size, __entry->size
+    )
+);
+
+#endif
+
+
+// * _ TRACE HEADER LOCATION ___________________________________________________
+// Found again through the includes directory given to the compiler. 
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE fifo_trace
+
+#include <trace/define_trace.h>
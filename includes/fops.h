@@ -11,38 +11,63 @@
 #include <linux/uaccess.h>
 #include <linux/wait.h>
 #include <linux/sched.h>
+#include <linux/poll.h>
 
 #include "configuration.h"
 #include "ioctl_command.h"
 #include "macros.h"
 #include "buffer.h"
+#include "shard.h"
 
 
-// * _ EXTERN GLOBAL VARIABLE DEFINITION _______________________________________
+// * _ FILE OPERATION FUNCTIONS ________________________________________________
 
-extern struct wait_queue_head   w_wait_queue; 
-extern FIFO_t                   fifos[FIFO_DEV_COUNT]; 
-extern bool                     w_is_unlock; 
+/// @brief open file operation override. 
+/// @param inode pointer to the inode structure. 
+/// @param fp    pointer to the file structure. 
+/// @return      0 if no error occurred, error code otherwise. 
+int fifo_open(struct inode* inode, struct file* fp); 
 
 
-// * _ FILE OPERATION FUNCTIONS ________________________________________________
+/// @brief release file operation override. 
+/// @param inode pointer to the inode structure. 
+/// @param fp    pointer to the file structure. 
+/// @return      0. 
+int fifo_release(struct inode* inode, struct file* fp); 
+
+
+/// @brief read_iter file operation override, used by read, readv and 
+///        asynchronous reads. 
+/// @param iocb I/O control block of the request, holding the file. 
+/// @param to   user-space segments to put read data into. 
+/// @return     the number of bytes returned by kernel space, -EAGAIN if the 
+///             FIFO is empty and the request can't wait. 
+ssize_t fifo_read_iter(struct kiocb* iocb, struct iov_iter* to); 
 
-/// @brief read file operation override. 
-/// @param fp  pointer to the file structure. 
-/// @param buf user-space buffer to put read data. 
-/// @param nbc number of character the process wants to read. 
-/// @param pos position of the read cursor. 
-/// @return    the number of bytes returned by kernel space. 
-ssize_t fifo_read(struct file* fp, char __user* buf, size_t nbc, loff_t* pos); 
 
+/// @brief write_iter file operation override, used by write, writev and 
+///        asynchronous writes. 
+/// @param iocb I/O control block of the request, holding the file. 
+/// @param from user-space segments containing what needs to be written. 
+/// @return     the number of bytes accepted, -EAGAIN if the FIFO is full and 
+///             the request can't wait. 
+ssize_t fifo_write_iter(struct kiocb* iocb, struct iov_iter* from); 
 
-/// @brief write file operation override. 
-/// @param fp  pointer to the file structure. 
-/// @param buf user-space buffer containing what needs to be written. 
-/// @param nbc number of character the process is writting. 
-/// @param pos position of the write cursor. 
-/// @return    the number of bytes returned by kernel space. 
-ssize_t fifo_write(struct file* fp, const char __user* buf, size_t nbc, loff_t* pos); 
+
+/// @brief poll file operation override, used by select, poll and epoll. 
+/// @param fp   pointer to the file structure. 
+/// @param wait poll table to register the device wait queues into. 
+/// @return     EPOLLIN when there is data to read, EPOLLOUT when there is space 
+///             to write. 
+__poll_t fifo_poll(struct file* fp, poll_table* wait); 
+
+
+/// @brief mmap file operation override, maps the ring control page and the 
+///        buffer of the device. 
+/// @param fp  pointer the the file structure. 
+/// @param vma mapping to fill. 
+/// @return    0 if no error occurred, negative otherwise. 
+int fifo_mmap(struct file* fp, struct vm_area_struct* vma); 
 
 
 /// @brief ioctl file operation override. 
@@ -54,4 +79,14 @@ ssize_t fifo_write(struct file* fp, const char __user* buf, size_t nbc, loff_t*
 /// @return      0 if no error occurred, error code otherwise. 
 long int fifo_ioctl(struct file *fp, unsigned int cmd, unsigned long arg); 
 
+
+/// @brief ioctl file operation of the control device, creating and destroying 
+///        FIFO devices. 
+/// @param fp  pointer the the file structure. 
+/// @param cmd IO_FIFO_CTL_CREATE or IO_FIFO_CTL_DESTROY, see the file 
+///            "ioctl_command.h". 
+/// @param arg pointer to the minor number of the device. 
+/// @return    0 if no error occurred, error code otherwise. 
+long int fifo_ctl_ioctl(struct file *fp, unsigned int cmd, unsigned long arg); 
+
 #endif 
\ No newline at end of file
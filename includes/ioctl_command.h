@@ -3,11 +3,117 @@
 
 #include <linux/ioctl.h>
 
+// * _ BATCH DEFINITIONS _______________________________________________________
+// Entries of a batch past this count are ignored. 
+#define FIFO_BATCH_MAX 1024
+
+/// @brief One message of a batch. 
+/// buf is the user-space address of the message. len is its length when 
+/// writing; when reading, it is the buffer size on entry and the length of 
+/// the message read on return. 
+typedef struct fifo_msg_t
+{
+    unsigned long long  buf; 
+    unsigned int        len; 
+    unsigned int        pad; 
+}   FIFO_msg_t; 
+
+/// @brief Argument of IO_FIFO_WRITE_BATCH and IO_FIFO_READ_BATCH, both return 
+/// the number of messages transferred. 
+typedef struct fifo_batch_t
+{
+    unsigned long long  msgs; 
+    unsigned int        count; 
+    unsigned int        pad; 
+}   FIFO_batch_t; 
+
+
+// * _ WATERMARKS DEFINITIONS __________________________________________________
+
+/// @brief Argument of IO_FIFO_SET_WATERMARKS and IO_FIFO_GET_WATERMARKS, in 
+/// bytes of used space. Blocked writers are woken once the used space drops to 
+/// low, blocked readers once it reaches high. low must be below the buffer 
+/// size, high between 1 and the buffer size. 
+typedef struct fifo_watermarks_t
+{
+    unsigned int    low; 
+    unsigned int    high; 
+}   FIFO_watermarks_t; 
+
+
 // * _ I/O CONTROL COMMANDS DEFINITIONS ________________________________________
 #define FIFO_MAGIC 0x40
 
 #define IO_FIFO_RESET      _IO(FIFO_MAGIC, 0)
 #define IO_FIFO_GET_R_CUR  _IOR(FIFO_MAGIC, 1, int)
 #define IO_FIFO_GET_W_CUR  _IOR(FIFO_MAGIC, 2, int)
+#define IO_FIFO_SET_SIZE   _IOWR(FIFO_MAGIC, 3, unsigned int)
+#define IO_FIFO_GET_SIZE   _IOR(FIFO_MAGIC, 4, unsigned int)
+#define IO_FIFO_NOTIFY     _IO(FIFO_MAGIC, 7)
+#define IO_FIFO_SET_MODE   _IOW(FIFO_MAGIC, 8, int)
+#define IO_FIFO_GET_MODE   _IOR(FIFO_MAGIC, 9, int)
+#define IO_FIFO_NEXT_SIZE  _IOR(FIFO_MAGIC, 10, unsigned int)
+#define IO_FIFO_WRITE_BATCH _IOW(FIFO_MAGIC, 11, FIFO_batch_t)
+#define IO_FIFO_READ_BATCH  _IOWR(FIFO_MAGIC, 12, FIFO_batch_t)
+#define IO_FIFO_RESET_STATS _IO(FIFO_MAGIC, 13)
+#define IO_FIFO_SET_WATERMARKS _IOW(FIFO_MAGIC, 14, FIFO_watermarks_t)
+#define IO_FIFO_GET_WATERMARKS _IOR(FIFO_MAGIC, 15, FIFO_watermarks_t)
+#define IO_FIFO_SET_MAX_LAG _IOW(FIFO_MAGIC, 16, unsigned int)
+#define IO_FIFO_GET_MAX_LAG _IOR(FIFO_MAGIC, 17, unsigned int)
+#define IO_FIFO_SET_NODE    _IOW(FIFO_MAGIC, 18, int)
+#define IO_FIFO_GET_NODE    _IOR(FIFO_MAGIC, 19, int)
+
+// * _ DEVICE MODES DEFINITIONS ________________________________________________
+// Flags given to IO_FIFO_SET_MODE. Without any, a device is a byte stream. 
+// FIFO_MODE_OVERWRITE makes writes drop the oldest data instead of waiting for 
+// space, with or without FIFO_MODE_RECORD. FIFO_MODE_BROADCAST gives every 
+// reader its own read cursor, so each one sees every byte; it can't be 
+// combined with FIFO_MODE_OVERWRITE. FIFO_MODE_SHARDED gives every CPU its own 
+// ring, so writers running on different CPUs never contend; it needs 
+// FIFO_MODE_RECORD and can't be combined with the other modes. Its reader 
+// drains the rings in turn, or oldest message first with FIFO_MODE_ORDERED. 
+#define FIFO_MODE_STREAM    0
+#define FIFO_MODE_RECORD    (1 << 0)
+#define FIFO_MODE_OVERWRITE (1 << 1)
+#define FIFO_MODE_BROADCAST (1 << 2)
+#define FIFO_MODE_SHARDED   (1 << 3)
+#define FIFO_MODE_ORDERED   (1 << 4)
+#define FIFO_MODE_MASK      (FIFO_MODE_RECORD | FIFO_MODE_OVERWRITE | FIFO_MODE_BROADCAST | \
+                             FIFO_MODE_SHARDED | FIFO_MODE_ORDERED)
+
+// * _ CONTROL DEVICE COMMANDS DEFINITIONS _____________________________________
+// Sent to /dev/fifo_ctl with a pointer to a minor number. 
+#define IO_FIFO_CTL_CREATE  _IOWR(FIFO_MAGIC, 5, int)
+#define IO_FIFO_CTL_DESTROY _IOW(FIFO_MAGIC, 6, int)
+
+// * _ SHARED RING DEFINITIONS _________________________________________________
+// Page offsets of a device mapping: the control page first, then the buffer. 
+#define FIFO_MMAP_RING_PGOFF 0
+#define FIFO_MMAP_DATA_PGOFF 1
+
+// Cache line size the control page is laid out for. 
+#define FIFO_CACHE_LINE 64
+
+/// @brief Control page of a FIFO device, shared with the processes mapping it. 
+/// The cursors are free-running byte counts, masked with size - 1 to index 
+/// the buffer. Each side only writes its own cursor, publishing it with 
+/// release semantics once the bytes behind it are written or read, and loads 
+/// the other one with acquire semantics. size is only informative, the driver 
+/// never trusts a value written in this page. 
+/// The reader and the writer each write their own cache line only: r_cur and 
+/// w_cache for the reader, w_cur and r_cache for the writer. w_cache and 
+/// r_cache are the last values of the other cursor their side loaded, so a 
+/// side only reads the line of the other one when its copy doesn't show 
+/// enough data or space. A copy may lag behind, never get ahead. 
+typedef struct fifo_ring_t
+{
+    unsigned int    r_cur; 
+    unsigned int    w_cache; 
+    unsigned int    size; 
+    unsigned char   r_pad[FIFO_CACHE_LINE - 3 * sizeof(unsigned int)]; 
+    unsigned int    w_cur; 
+    unsigned int    r_cache; 
+    unsigned char   w_pad[FIFO_CACHE_LINE - 2 * sizeof(unsigned int)]; 
+}   FIFO_ring_t; 
 
 #endif
\ No newline at end of file
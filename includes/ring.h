@@ -0,0 +1,351 @@
+#ifndef _RING_H_
+#define _RING_H_
+
+// The ring core: cursor arithmetic, wrapping copies, message framing and the 
+// publication protocol shared by the driver and user-space. Built into the 
+// module, and as is into user-space programs such as tests/bench.c, which 
+// exercise it without loading the module. 
+#ifdef __KERNEL__
+    #include <linux/types.h>
+    #include <linux/errno.h>
+    #include <linux/string.h>
+    #include <linux/atomic.h>
+    #include <asm/barrier.h>
+
+    #define RING_LOAD_ACQUIRE(ptr)              smp_load_acquire(ptr)
+    #define RING_STORE_RELEASE(ptr, val)        smp_store_release(ptr, val)
+    #define RING_CMPXCHG(ptr, old, new)         cmpxchg(ptr, old, new)
+    #define RING_CMPXCHG_RELEASE(ptr, old, new) cmpxchg_release(ptr, old, new)
+#else
+    #include <stdbool.h>
+    #include <string.h>
+    #include <errno.h>
+
+    #define RING_LOAD_ACQUIRE(ptr)              __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+    #define RING_STORE_RELEASE(ptr, val)        __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+    #define RING_CMPXCHG(ptr, old, new)         __sync_val_compare_and_swap(ptr, old, new)
+    #define RING_CMPXCHG_RELEASE(ptr, old, new) __sync_val_compare_and_swap(ptr, old, new)
+#endif
+
+#include "ioctl_command.h"
+
+
+// * _ DEFINES _________________________________________________________________
+
+// Size of the length header stored before each message in record mode. 
+#define RING_RECORD_HEADER  sizeof(unsigned int)
+
+
+// * _ RING FUNCTIONS __________________________________________________________
+// Every function takes the buffer and its size, a power of two. The cursors 
+// are free-running byte counts, masked with size - 1 to index the buffer. 
+
+/// @brief Return the used space between two cursors. The cursors may come 
+///        from memory a process can write, so the result is capped to the 
+///        buffer size. 
+/// @param r_cur read cursor. 
+/// @param w_cur write cursor. 
+/// @param size  buffer size. 
+/// @return the used space in bytes. 
+static inline unsigned int ring_used(unsigned int r_cur, unsigned int w_cur, unsigned int size)
+{
+    return w_cur - r_cur < size ? w_cur - r_cur : size; 
+}
+
+
+/// @brief Return the used space a writer sees, from its copy of the read 
+///        cursor while it leaves len bytes free. Only then is the read cursor 
+///        loaded, and the copy refreshed: the line of the reader is left 
+///        alone as long as there is room. 
+/// @param ctl   control structure holding the cursors. 
+/// @param w_cur write cursor. 
+/// @param size  buffer size. 
+/// @param len   number of free bytes the writer needs. 
+/// @return the used space in bytes, against ctl->r_cache. 
+static inline unsigned int ring_write_used(FIFO_ring_t* ctl, unsigned int w_cur, unsigned int size, unsigned int len)
+{
+    unsigned int used; 
+
+    // A copy ahead of the write cursor is stale from before a reset, or was 
+    // written through a mapping. 
+    used = w_cur - ctl->r_cache; 
+    if (used <= size && size - used >= len)
+        return used; 
+
+    // The reader is done with every byte up to the cursor we load. 
+    ctl->r_cache = RING_LOAD_ACQUIRE(&(ctl->r_cur)); 
+    return ring_used(ctl->r_cache, w_cur, size); 
+}
+
+
+/// @brief Return the used space a reader sees, from its copy of the write 
+///        cursor while it shows len bytes. Only then is the write cursor 
+///        loaded, and the copy refreshed. 
+/// @param ctl   control structure holding the cursors. 
+/// @param r_cur read cursor. 
+/// @param size  buffer size. 
+/// @param len   number of bytes the reader needs. 
+/// @return the used space in bytes, against ctl->w_cache. 
+static inline unsigned int ring_read_used(FIFO_ring_t* ctl, unsigned int r_cur, unsigned int size, unsigned int len)
+{
+    unsigned int used; 
+
+    // A writer dropping data may have moved the read cursor past the copy. 
+    // The bytes behind the copy were visible when it was loaded. 
+    used = ctl->w_cache - r_cur; 
+    if (used && used <= size && used >= len)
+        return used; 
+
+    // Every byte behind the write cursor we load is visible. 
+    ctl->w_cache = RING_LOAD_ACQUIRE(&(ctl->w_cur)); 
+    return ring_used(r_cur, ctl->w_cache, size); 
+}
+
+
+/// @brief Empty a ring, with both of its sides owned. 
+/// @param ctl control structure holding the cursors. 
+static inline void ring_rewind(FIFO_ring_t* ctl)
+{
+    ctl->r_cur = 0; 
+    ctl->w_cur = 0; 
+    ctl->r_cache = 0; 
+    ctl->w_cache = 0; 
+}
+
+
+/// @brief Copy bytes out of the ring, wrapping at the end of the buffer. 
+/// @param buffer ring buffer. 
+/// @param size   buffer size. 
+/// @param cur    free-running cursor of the first byte. 
+/// @param dst    destination buffer. 
+/// @param len    number of bytes to copy, at most the buffer size. 
+static inline void ring_peek(const unsigned char* buffer, unsigned int size, unsigned int cur, void* dst, unsigned int len)
+{
+    unsigned int pos; 
+    unsigned int first_seg; 
+
+    pos = cur & (size - 1); 
+    first_seg = len < size - pos ? len : size - pos; 
+
+    memcpy(dst, buffer + pos, first_seg); 
+    memcpy((unsigned char*)dst + first_seg, buffer, len - first_seg); 
+}
+
+
+/// @brief Copy bytes into the ring, wrapping at the end of the buffer. 
+/// @param buffer ring buffer. 
+/// @param size   buffer size. 
+/// @param cur    free-running cursor of the first byte. 
+/// @param src    source buffer. 
+/// @param len    number of bytes to copy, at most the buffer size. 
+static inline void ring_poke(unsigned char* buffer, unsigned int size, unsigned int cur, const void* src, unsigned int len)
+{
+    unsigned int pos; 
+    unsigned int first_seg; 
+
+    pos = cur & (size - 1); 
+    first_seg = len < size - pos ? len : size - pos; 
+
+    memcpy(buffer + pos, src, first_seg); 
+    memcpy(buffer, (const unsigned char*)src + first_seg, len - first_seg); 
+}
+
+
+/// @brief Read the length of the message at a read cursor of a record ring. 
+/// @param buffer ring buffer. 
+/// @param size   buffer size. 
+/// @param r_cur  read cursor. 
+/// @param used   used space, not empty. 
+/// @return the message length, -EIO if the header is corrupted. 
+static inline int ring_record_length(const unsigned char* buffer, unsigned int size, unsigned int r_cur, unsigned int used)
+{
+    unsigned int len; 
+
+    // The header is published with its message, the whole message follows 
+    // it. Anything else was written through a mapping. 
+    len = 0; 
+    if (used >= RING_RECORD_HEADER)
+        ring_peek(buffer, size, r_cur, &len, RING_RECORD_HEADER); 
+
+    if (!len || len > used - RING_RECORD_HEADER)
+        return -EIO; 
+
+    return len; 
+}
+
+
+/// @brief Drop the oldest data of a ring until len bytes fit after the write 
+///        cursor, for the single writer of an overwrite mode ring. The read 
+///        cursor is moved with a compare and exchange, so a reader consuming 
+///        at the same time is never overtaken by more than needed. 
+/// @param ctl     control structure holding the cursors. 
+/// @param buffer  ring buffer. 
+/// @param size    buffer size. 
+/// @param w_cur   write cursor. 
+/// @param len     number of bytes needed after the write cursor, at most the 
+///                buffer size. 
+/// @param record  true to drop whole messages. 
+/// @param dropped set to the number of bytes dropped. 
+/// @return the number of messages dropped, 0 in stream mode. 
+static inline unsigned int ring_overwrite(FIFO_ring_t* ctl, const unsigned char* buffer, unsigned int size,
+                                          unsigned int w_cur, unsigned int len, bool record, unsigned int* dropped)
+{
+    unsigned int    r_cur; 
+    unsigned int    r_next; 
+    unsigned int    used; 
+    unsigned int    msgs; 
+    int             msg_len; 
+
+    while (true)
+    {
+        *dropped = 0; 
+        r_cur = RING_LOAD_ACQUIRE(&(ctl->r_cur)); 
+        used = ring_used(r_cur, w_cur, size); 
+        if (used + len <= size)
+            return 0; 
+
+        // Find the new oldest byte: just enough behind the write cursor in 
+        // stream mode, the first message after enough of them in record mode. 
+        // A corrupted header drops everything. 
+        msgs = 0; 
+        r_next = w_cur + len - size; 
+        if (record)
+        {
+            r_next = w_cur - used; 
+            while (w_cur - r_next + len > size)
+            {
+                msg_len = ring_record_length(buffer, size, r_next, w_cur - r_next); 
+                if (msg_len < 0)
+                {
+                    r_next = w_cur; 
+                    break; 
+                }
+
+                r_next += RING_RECORD_HEADER + msg_len; 
+                msgs += 1; 
+            }
+        }
+
+        // The exchange fails if a reader consumed in the meantime, then look 
+        // again from its new cursor. It is fully ordered, so a reader can't 
+        // see the bytes written next without seeing the cursor moved. 
+        if (RING_CMPXCHG(&(ctl->r_cur), r_cur, r_next) == r_cur)
+        {
+            *dropped = r_next - (w_cur - used); 
+            return msgs; 
+        }
+    }
+}
+
+
+/// @brief Move the read cursor once bytes were read. 
+/// @param ctl       control structure holding the cursors. 
+/// @param r_cur     read cursor the read started from. 
+/// @param r_next    read cursor after the bytes read. 
+/// @param overwrite true if a writer may drop data under the reader. 
+/// @return true if the cursor moved, false if a writer in overwrite mode 
+///         dropped the bytes in the meantime, then the read must start over. 
+static inline bool ring_consume(FIFO_ring_t* ctl, unsigned int r_cur, unsigned int r_next, bool overwrite)
+{
+    // The release orders our reads of the ring before the writer reuses the 
+    // space. Only an overwriting writer moves the read cursor besides us. 
+    if (!overwrite)
+    {
+        RING_STORE_RELEASE(&(ctl->r_cur), r_next); 
+        return true; 
+    }
+
+    return RING_CMPXCHG_RELEASE(&(ctl->r_cur), r_cur, r_next) == r_cur; 
+}
+
+
+/// @brief Write to a ring without waiting, for its single writer. A message 
+///        is written whole after its header in record mode, stream mode 
+///        writes as many bytes as fit. 
+/// @param ctl    control structure holding the cursors. 
+/// @param buffer ring buffer. 
+/// @param size   buffer size. 
+/// @param src    bytes to write. 
+/// @param len    number of bytes to write. 
+/// @param record true to write a message. 
+/// @return the number of bytes written, -EAGAIN if they don't fit yet, 
+///         -EMSGSIZE if the message never will. 
+static inline int ring_write(FIFO_ring_t* ctl, unsigned char* buffer, unsigned int size,
+                             const void* src, unsigned int len, bool record)
+{
+    unsigned int    header; 
+    unsigned int    w_cur; 
+    unsigned int    free_space; 
+
+    header = record ? RING_RECORD_HEADER : 0; 
+    if (record && len > size - header)
+        return -EMSGSIZE; 
+
+    // A whole message needs its header, a stream write takes what fits. 
+    w_cur = ctl->w_cur; 
+    free_space = size - ring_write_used(ctl, w_cur, size, len + header); 
+
+    if (!record && len > free_space)
+        len = free_space; 
+
+    if (!len || free_space < len + header)
+        return -EAGAIN; 
+
+    // Publish the header and the bytes together. 
+    ring_poke(buffer, size, w_cur + header, src, len); 
+    ring_poke(buffer, size, w_cur, &len, header); 
+    RING_STORE_RELEASE(&(ctl->w_cur), w_cur + header + len); 
+    return len; 
+}
+
+
+/// @brief Read from a ring without waiting, for its single reader. A message 
+///        is read whole without its header in record mode, stream mode reads 
+///        as many bytes as available. 
+/// @param ctl    control structure holding the cursors. 
+/// @param buffer ring buffer. 
+/// @param size   buffer size. 
+/// @param dst    destination buffer. 
+/// @param len    size of the destination buffer. 
+/// @param record true to read a message. 
+/// @return the number of bytes read, -EAGAIN if the ring is empty, 
+///         -EMSGSIZE if the next message is larger than len, -EIO if its 
+///         header is corrupted. 
+static inline int ring_read(FIFO_ring_t* ctl, const unsigned char* buffer, unsigned int size,
+                            void* dst, unsigned int len, bool record)
+{
+    unsigned int    header; 
+    unsigned int    r_cur; 
+    unsigned int    used; 
+    int             msg_len; 
+
+    // A message is published whole, any byte means one is there. A stream 
+    // read takes as much as the request holds. 
+    r_cur = ctl->r_cur; 
+    used = ring_read_used(ctl, r_cur, size, record ? 1 : (len < size ? len : size)); 
+    if (!used)
+        return -EAGAIN; 
+
+    header = 0; 
+    if (record)
+    {
+        msg_len = ring_record_length(buffer, size, r_cur, used); 
+        if (msg_len < 0)
+            return msg_len; 
+
+        if ((unsigned int)msg_len > len)
+            return -EMSGSIZE; 
+
+        header = RING_RECORD_HEADER; 
+        len = msg_len; 
+    }
+
+    else if (len > used)
+        len = used; 
+
+    ring_peek(buffer, size, r_cur + header, dst, len); 
+    ring_consume(ctl, r_cur, r_cur + header + len, false); 
+    return len; 
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef _SHARD_H_
+#define _SHARD_H_
+
+#include <linux/kernel.h>
+#include <linux/uio.h>
+#include <linux/smp.h>
+
+#include "configuration.h"
+#include "ioctl_command.h"
+#include "macros.h"
+#include "buffer.h"
+
+
+// * _ STRUCTURE DEFINITIONS ___________________________________________________
+
+/// @brief A ring the reader of a sharded FIFO takes a message from, with the 
+/// cursors it loaded: the main ring, or the ring of cpu. header is the size of 
+/// the header of its messages. 
+typedef struct fifo_source_t
+{
+    FIFO_ring_t*        ctl; 
+    unsigned char*      buffer; 
+    unsigned int        size; 
+    unsigned int        header; 
+    unsigned int        r_cur; 
+    unsigned int        w_cur; 
+    unsigned int        cpu; 
+}   FIFO_source_t; 
+
+
+// * _ FUNCTION DECLARATIONS ___________________________________________________
+
+/// @brief Allocate the per CPU rings of a fifo entering sharded mode, unless 
+///        it already has them. Called with shard_sem taken for writing. 
+/// @param fifo pointer to a fifo structure. 
+/// @return 0 if no error occurred, -ENOMEM otherwise. 
+int fifo_shard_init(FIFO_t* fifo); 
+
+
+/// @brief Free the buffers of the per CPU rings of a fifo, the next write on 
+///        each CPU allocates it again at the current size. Called with 
+///        shard_sem taken for writing. 
+/// @param fifo pointer to a fifo structure. 
+void fifo_shard_release(FIFO_t* fifo); 
+
+
+/// @brief Empty the per CPU rings of a fifo. Called with both sides and 
+///        shard_sem taken for writing. 
+/// @param fifo pointer to a fifo structure. 
+void fifo_shard_reset(FIFO_t* fifo); 
+
+
+/// @brief Free the per CPU rings of a fifo being destroyed. 
+/// @param fifo pointer to a fifo structure. 
+void fifo_shard_destroy(FIFO_t* fifo); 
+
+
+/// @brief Return the number of bytes stored in every per CPU ring of a fifo. 
+/// @param fifo pointer to a fifo structure. 
+/// @return the used space in bytes, headers included. 
+unsigned int fifo_shard_used(FIFO_t* fifo); 
+
+
+/// @brief Check whether a sharded fifo holds a message, in its main ring or 
+///        in the ring of a CPU. 
+/// @param fifo pointer to a fifo structure. 
+/// @return true if blocked readers can be woken. 
+bool fifo_shard_readable(FIFO_t* fifo); 
+
+
+/// @brief Find the ring the next message of a sharded fifo is read from, 
+///        with the read side owned: the main ring while it holds data, then 
+///        the ring of the CPU after the last one read, or the one holding the 
+///        oldest message in ordered mode. 
+/// @param fifo pointer to a fifo structure. 
+/// @param src  set to the ring found and its cursors. 
+/// @return true if a ring holds a message, false if the fifo is empty. 
+bool fifo_shard_pick(FIFO_t* fifo, FIFO_source_t* src); 
+
+
+/// @brief Read the length of the message at the read cursor of a ring found 
+///        by fifo_shard_pick. 
+/// @param src ring and cursors. 
+/// @return the message length, -EIO if its header is corrupted. 
+int fifo_shard_length(FIFO_source_t* src); 
+
+
+/// @brief Return the length of the next message of a sharded fifo, with the 
+///        read side owned. 
+/// @param fifo pointer to a fifo structure. 
+/// @return the length in bytes, 0 if the fifo is empty, -EIO if its header is 
+///         corrupted. 
+int fifo_shard_next_size(FIFO_t* fifo); 
+
+
+/// @brief Write a message to the ring of the CPU the caller runs on, after a 
+///        header holding its length and the time. Only the writers running on 
+///        the same CPU wait for each other. 
+/// @param fifo    pointer to a fifo structure. 
+/// @param from    user-space segments holding the message. 
+/// @param nbc     length of the message. 
+/// @param nowait  true to return -EAGAIN instead of sleeping. 
+/// @param sharded set to false if the device left sharded mode, then nothing 
+///                was written and the caller takes the usual path. 
+/// @return the message length, -EMSGSIZE if it can't fit in a ring, -EAGAIN, 
+///         -ENOMEM, -ERESTARTSYS or -EFAULT otherwise. 
+ssize_t fifo_shard_write(FIFO_t* fifo, struct iov_iter* from, size_t nbc, bool nowait, bool* sharded); 
+
+
+/// @brief Read the next message of a sharded fifo, whole and without its 
+///        header. Sleeps while every ring is empty. 
+/// @param fifo    pointer to a fifo structure. 
+/// @param to      user-space segments to fill. 
+/// @param nbc     size of the user-space segments. 
+/// @param nowait  true to return -EAGAIN instead of sleeping. 
+/// @param sharded set to false if the device left sharded mode, then nothing 
+///                was read and the caller takes the usual path. 
+/// @return the message length, -EMSGSIZE if it is larger than nbc, -EIO if 
+///         its header is corrupted, -EAGAIN, -ERESTARTSYS or -EFAULT 
+///         otherwise. 
+ssize_t fifo_shard_read(FIFO_t* fifo, struct iov_iter* to, size_t nbc, bool nowait, bool* sharded); 
+
+
+/// @brief Report the state of a sharded fifo to poll: readable once any ring 
+///        holds a message, writable while the ring of the polling CPU is down 
+///        to the low watermark. 
+/// @param fifo pointer to a fifo structure. 
+/// @return the poll mask. 
+__poll_t fifo_shard_poll(FIFO_t* fifo); 
+
+#endif
@@ -1,7 +1,3 @@
-/*
-TODO: support non blocking mode -> return -EAGAIN without writing (free space detection). 
-*/
-
 #include <linux/version.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
@@ -12,6 +8,9 @@ TODO: support non blocking mode -> return -EAGAIN without writing (free space de
 #include <linux/uaccess.h>
 #include <linux/wait.h>
 #include <linux/sched.h>
+#include <linux/moduleparam.h>
+#include <linux/idr.h>
+#include <linux/debugfs.h>
 
 #include "configuration.h"
 #include "ioctl_command.h"
@@ -38,7 +37,7 @@ MODULE_AUTHOR("Romain FLACHAT");
 MODULE_DESCRIPTION(
     "Character device driver implementing /dev/fifo* as a blocking FIFO with "
     "mutex-protected read/write. Exposes FIFO status via sysfs "
-    "(/sys/class/fifo/*: used, free, view) and provides ioctl interface for "
+    "(/sys/class/fifo/*: used, free, stat, view) and provides ioctl interface for "
     "buffer reset and cursor position retrieval."
 );
 
@@ -46,27 +45,84 @@ MODULE_DESCRIPTION(
 
 // * _ GLOBAL VARIABLES ________________________________________________________
 
-// Create a "wait_queue_head" structure named w_wait_queue. 
-DECLARE_WAIT_QUEUE_HEAD(w_wait_queue);
-
 // Create a "device_attribute" structure named dev_attr_buffer. 
 DEVICE_ATTR(view, 0444, fifo_buffer_show, NULL);
 DEVICE_ATTR(free, 0444, fifo_free_space_show, NULL);
 DEVICE_ATTR(used, 0444, fifo_used_space_show, NULL);
-
-// File operation structure used by the driver. 
+DEVICE_ATTR(stat, 0444, fifo_stat_show, NULL);
+DEVICE_ATTR(stats, 0444, fifo_stats_show, NULL);
+DEVICE_ATTR(dropped, 0444, fifo_dropped_show, NULL);
+DEVICE_ATTR(readers, 0444, fifo_readers_show, NULL);
+DEVICE_ATTR(shards, 0444, fifo_shards_show, NULL);
+DEVICE_ATTR(node, 0444, fifo_node_show, NULL);
+DEVICE_ATTR(cpus, 0444, fifo_cpus_show, NULL);
+DEVICE_ATTR(backing, 0444, fifo_backing_show, NULL);
+
+// File operation structure used by the FIFO devices. Splicing goes through 
+// read_iter and write_iter, straight between the ring and the pipe pages. 
 struct file_operations fifo_fops = {
     .owner          = THIS_MODULE, 
-    .read           = fifo_read,
-    .write          = fifo_write,
+    .open           = fifo_open, 
+    .release        = fifo_release, 
+    .read_iter      = fifo_read_iter, 
+    .write_iter     = fifo_write_iter, 
+    .splice_read    = copy_splice_read, 
+    .splice_write   = iter_file_splice_write, 
+    .poll           = fifo_poll, 
+    .mmap           = fifo_mmap, 
     .unlocked_ioctl = fifo_ioctl, 
     .compat_ioctl   = fifo_ioctl, 
 };
 
+// File operation structure used by the control device. 
+struct file_operations fifo_ctl_fops = {
+    .owner          = THIS_MODULE, 
+    .unlocked_ioctl = fifo_ctl_ioctl, 
+    .compat_ioctl   = fifo_ctl_ioctl, 
+};
+
+// File operation structure of the debugfs wait latency histograms. 
+const struct file_operations fifo_hist_fops = {
+    .owner          = THIS_MODULE, 
+    .open           = fifo_hist_open, 
+    .read           = seq_read, 
+    .llseek         = seq_lseek, 
+    .release        = single_release, 
+};
+
+// Devices registered by minor, and the mutex protecting it. 
+DEFINE_IDR(fifo_idr); 
+DEFINE_MUTEX(fifo_idr_mutex); 
+
 unsigned int    fifo_major = FIFO_MAJOR_NUMBER; 
-FIFO_t          fifos[FIFO_DEV_COUNT]; 
+struct cdev     fifo_cdev; 
+struct cdev     fifo_ctl_cdev; 
+struct device*  fifo_ctl_device; 
 struct class*   fifo_class;
-bool            w_is_unlock; 
+struct dentry*  fifo_debugfs; 
+bool            spsc_enabled = FIFO_SPSC_ENABLED; 
+bool            overwrite = FIFO_OVERWRITE; 
+
+// Allow the single reader/single writer fast path to be turned off, from 
+// insmod or at runtime through /sys/module/fifo/parameters/spsc_enabled. 
+module_param(spsc_enabled, bool, 0644); 
+MODULE_PARM_DESC(spsc_enabled, "Skip the mutexes while a side has a single opener."); 
+
+// Default buffer size of every device, each one can then be resized with the 
+// IO_FIFO_SET_SIZE ioctl. 
+unsigned int    buffer_size = FIFO_BUFFER_SIZE; 
+module_param(buffer_size, uint, 0444); 
+MODULE_PARM_DESC(buffer_size, "Default buffer size in bytes, rounded up to a power of two."); 
+
+// Start every new device in overwrite mode, each one can then be switched 
+// with the IO_FIFO_SET_MODE ioctl. 
+module_param(overwrite, bool, 0644); 
+MODULE_PARM_DESC(overwrite, "Create devices dropping their oldest data instead of blocking writers."); 
+
+// Back large buffers with 2MB pages, from the next allocation of each one. 
+bool            huge_pages = FIFO_HUGE_PAGES; 
+module_param(huge_pages, bool, 0644); 
+MODULE_PARM_DESC(huge_pages, "Back buffers of 2MB and more with 2MB pages when available."); 
 
 
 // * _ MODULE ENTRY POINT ______________________________________________________
@@ -79,20 +135,61 @@ bool            w_is_unlock;
 
 // * _ INITIALIZATION & EXIT FUNCTIONS _________________________________________
 
+/// @brief Destroy every device and unregister everything fifo_init registered. 
+///        Shared by the exit function and the error path of fifo_init. 
+static void fifo_teardown(void)
+{
+    FIFO_t* fifo; 
+    int     minor; 
+
+    // Unload each devices, free allocated memory and destroy class devices. 
+    idr_for_each_entry(&fifo_idr, fifo, minor)
+        fifo_destroy(minor); 
+
+    idr_destroy(&fifo_idr); 
+    debugfs_remove(fifo_debugfs); 
+
+    if (fifo_ctl_device && !IS_ERR(fifo_ctl_device))
+        device_destroy(fifo_class, MKDEV(fifo_major, FIFO_CTL_MINOR)); 
+
+    if (fifo_ctl_cdev.ops)
+        cdev_del(&fifo_ctl_cdev); 
+
+    if (fifo_cdev.ops)
+        cdev_del(&fifo_cdev); 
+
+    if (fifo_class && !IS_ERR(fifo_class))
+        class_destroy(fifo_class);
+
+    // Unregister the MAJOR. 
+    unregister_chrdev_region(MKDEV(fifo_major, 0), FIFO_MAX_DEVICES + 1); 
+}
+
+
 int __init fifo_init(void)
 {
     dev_t   devno;
     int     retval; 
     int     i; 
     
+    // Check the buffer size given when loading the module. 
+    if (!fifo_round_size(buffer_size))
+    {
+        ERR_DEBUG(
+            "[FIFO] buffer_size must be between %d and %d bytes, exiting...\n", 
+            FIFO_BUFFER_MIN_SIZE, FIFO_BUFFER_MAX_SIZE
+        ); 
+        return -EINVAL; 
+    }
+
     devno = MKDEV(fifo_major, 0);
     
-    // Register major number and devices. 
+    // Register major number and every minor, devices and control device. 
     if (fifo_major)
-        retval = register_chrdev_region(devno, FIFO_DEV_COUNT, "fifo");
+        retval = register_chrdev_region(devno, FIFO_MAX_DEVICES + 1, "fifo");
 
     else 
-        retval = alloc_chrdev_region(&devno, 0, FIFO_DEV_COUNT, "fifo");
+        retval = alloc_chrdev_region(&devno, 0, FIFO_MAX_DEVICES + 1, "fifo");
 
     if (retval < 0)
     {
@@ -106,18 +203,66 @@ int __init fifo_init(void)
 
     fifo_class = class_create("fifo");
     if (IS_ERR(fifo_class))
-        return PTR_ERR(fifo_class);
+    {
+        retval = PTR_ERR(fifo_class); 
+        fifo_teardown(); 
+        return retval; 
+    }
+
+    // Directory of the wait latency histograms, /sys/kernel/debug/fifo. 
+    fifo_debugfs = debugfs_create_dir("fifo", NULL); 
+
+    // A single cdev covers every device minor, the open function finds the 
+    // FIFO_t structure of the minor in the idr. 
+    cdev_init(&fifo_cdev, &fifo_fops); 
+    fifo_cdev.owner = THIS_MODULE; 
+
+    retval = cdev_add(&fifo_cdev, MKDEV(fifo_major, 0), FIFO_MAX_DEVICES); 
+    if (retval)
+    {
+        ERR_DEBUG("[FIFO] devices not added correctly, exiting...\n"); 
+        fifo_teardown(); 
+        return -ENODEV; 
+    }
+
+    // Register the control device used to create and destroy devices. 
+    cdev_init(&fifo_ctl_cdev, &fifo_ctl_fops); 
+    fifo_ctl_cdev.owner = THIS_MODULE; 
+
+    retval = cdev_add(&fifo_ctl_cdev, MKDEV(fifo_major, FIFO_CTL_MINOR), 1); 
+    if (retval)
+    {
+        ERR_DEBUG("[FIFO] control device not added correctly, exiting...\n"); 
+        fifo_teardown(); 
+        return -ENODEV; 
+    }
+
+    fifo_ctl_device = device_create(
+        fifo_class, 
+        NULL, 
+        MKDEV(fifo_major, FIFO_CTL_MINOR), 
+        NULL, 
+        "fifo_ctl"
+    ); 
+
+    if (IS_ERR(fifo_ctl_device))
+    {
+        retval = PTR_ERR(fifo_ctl_device); 
+        fifo_teardown(); 
+        return retval; 
+    }
 
-    // Initialize the FIFO_t structure by allocation buffer memory and and 
-    // minor device. 
+    // Create the devices available from the start. 
     for (i = 0; i < FIFO_DEV_COUNT; i += 1)
     {
-        retval = init_fifo(&(fifos[i]), i, &fifo_fops); 
-        if (retval)
-            return -EFAULT; 
+        retval = fifo_create(i); 
+        if (retval < 0)
+        {
+            fifo_teardown(); 
+            return retval; 
+        }
     } 
 
-    w_is_unlock = true; 
     printk(KERN_INFO "[FIFO] driver loaded successfully!\n"); 
     return 0; 
 }
@@ -126,20 +271,7 @@ int __init fifo_init(void)
 #ifdef MODULE_COMPILATION
     static void __exit fifo_exit(void)
     {
-        int i; 
-
-        // Unload each devices, free allocated memory, destroy class devices
-        // and unregister the MAJOR. 
-        for (i = 0; i < FIFO_DEV_COUNT; i += 1)
-        {
-            cdev_del(&(fifos[i].cdev)); 
-            device_destroy(fifo_class, MKDEV(fifo_major, i));
-            kfree(fifos[i].buffer); 
-        } 
-
-        class_destroy(fifo_class);
-
-        unregister_chrdev_region(MKDEV(fifo_major, 0), FIFO_DEV_COUNT); 
+        fifo_teardown(); 
         printk(KERN_INFO "[FIFO] driver unloaded successfully, goodbye!\n"); 
         return; 
     }
@@ -9,7 +9,6 @@ if [ "$USER" != "root" ] ; then
 fi
 
 cdev_name="fifo"
-cdev_count=3
 username=romain
 major=`grep $cdev_name /proc/devices |cut -d' ' -f1`
 
@@ -31,21 +30,29 @@ if [ "$major" = "" ]; then
    exit 2
 fi
 echo "~[INFO] MAJOR number is: $major."
-i=0
-while [ $i -lt $cdev_count ]
-do
-   dev=/dev/$cdev_name$i
-   if [ $del -eq 1 ]; then
+
+# Devices are created and destroyed at runtime, go through the ones currently 
+# registered in /sys/class/fifo/ (including fifo_ctl) instead of a fixed count. 
+# When uninstalling, also remove the nodes of devices destroyed since. 
+if [ $del -eq 1 ]; then
+   for dev in /dev/$cdev_name[0-9]* /dev/${cdev_name}_ctl
+   do
       [ -e $dev ] && rm -f $dev
+   done
+   exit 0
+fi
+
+for entry in /sys/class/$cdev_name/*
+do
+   [ -e $entry/dev ] || continue
+   dev=/dev/`basename $entry`
+   minor=`cut -d: -f2 $entry/dev`
+   if [ ! -e $dev ] ; then
+         mknod $dev c $major $minor
+         sudo chown -R $username: $dev
    else
-      if [ ! -e $dev ] ; then
-            mknod $dev c $major $i
-            sudo chown -R $username: $dev
-      else
-            echo "~[ERR] $dev already exist, abort."
-      fi
+         echo "~[ERR] $dev already exist, abort."
    fi
-   i=`expr $i + 1`
 done
 
 exit 0
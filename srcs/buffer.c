@@ -1,128 +1,1284 @@
 #include "buffer.h"
+#include "shard.h"
 
+// Tracepoints are instantiated once, in this file. 
+#define CREATE_TRACE_POINTS
+#include "fifo_trace.h"
 
-int init_fifo(FIFO_t* fifo, unsigned int minor, struct file_operations* fops)
+
+// * _ SIDE OWNERSHIP __________________________________________________________
+
+/// @brief Take an owner word, sleeping until its current owner releases it. 
+/// @param owner owner word of the side to take. 
+/// @return 0 once owned, -ERESTARTSYS if a signal interrupted the wait. 
+static int fifo_claim(atomic_t* owner)
 {
-    dev_t   dev_minor; 
-    int     retval; 
-    int     i; 
+    int state; 
 
-    dev_minor = MKDEV(fifo_major, minor); 
+    state = atomic_cmpxchg_acquire(owner, 0, 1); 
+    if (!state)
+        return 0; 
 
-    // Initialize the cdev associated to the FIFO_t structure and minor number. 
-    cdev_init(&(fifo->cdev), fops); 
-    fifo->cdev.owner = THIS_MODULE;
-    fifo->cdev.ops = fops;
+    // Mark the side as contended so the owner wakes us up when leaving, then 
+    // retry until we are the one that finds it free. 
+    if (state != 2)
+        state = atomic_xchg_acquire(owner, 2); 
 
-    // Register the character device. 
-    retval = cdev_add(&(fifo->cdev), dev_minor, 1);
-    if (retval)
+    while (state)
     {
-        ERR_DEBUG("[FIFO] device %d not added correctly, abort.\n", minor);
-        return -ENODEV; 
+        if (wait_var_event_interruptible(owner, atomic_read(owner) != 2))
+            return -ERESTARTSYS; 
+
+        state = atomic_xchg_acquire(owner, 2); 
+    }
+
+    return 0; 
+}
+
+
+/// @brief Release an owner word and wake up a waiter if there is one. 
+/// @param owner owner word of the side to release. 
+static void fifo_unclaim(atomic_t* owner)
+{
+    // The exchange is fully ordered, which wake_up_var() needs to see a 
+    // sleeper that registered before the release. 
+    if (atomic_xchg(owner, 0) == 2)
+        wake_up_var(owner); 
+}
+
+
+/// @brief Take one side of a FIFO. 
+/// @param fifo    pointer to the fifo, to count contention. 
+/// @param mutex   mutex of the side, serializing concurrent openers. 
+/// @param owner   owner word of the side. 
+/// @param openers number of openers of the side, NULL to force the mutex. 
+/// @return FIFO_LOCK_FAST or FIFO_LOCK_MUTEX, -ERESTARTSYS if interrupted. 
+static int fifo_side_lock(FIFO_t* fifo, struct mutex* mutex, atomic_t* owner, atomic_t* openers)
+{
+    // Single opener: a free owner word is all we need. 
+    if (spsc_enabled && openers && atomic_read(openers) <= 1 && 
+        !atomic_cmpxchg_acquire(owner, 0, 1))
+        return FIFO_LOCK_FAST; 
+
+    // Only count the mutexes we have to wait for. 
+    if (!mutex_trylock(mutex))
+    {
+        FIFO_COUNT(fifo, contended, 1); 
+        if (mutex_lock_interruptible(mutex))
+            return -ERESTARTSYS;
+    }
+
+    // A lockless caller that started before the second opener showed up may 
+    // still be working on this side, wait for it to leave. 
+    if (fifo_claim(owner))
+    {
+        mutex_unlock(mutex); 
+        return -ERESTARTSYS;
+    }
+
+    return FIFO_LOCK_MUTEX; 
+}
+
+
+/// @brief Take one side of a FIFO without sleeping. 
+/// @param mutex   mutex of the side. 
+/// @param owner   owner word of the side. 
+/// @param openers number of openers of the side. 
+/// @return FIFO_LOCK_FAST or FIFO_LOCK_MUTEX, -EAGAIN if the side is busy. 
+static int fifo_side_trylock(struct mutex* mutex, atomic_t* owner, atomic_t* openers)
+{
+    if (spsc_enabled && atomic_read(openers) <= 1)
+        return atomic_cmpxchg_acquire(owner, 0, 1) ? -EAGAIN : FIFO_LOCK_FAST; 
+
+    if (!mutex_trylock(mutex))
+        return -EAGAIN; 
+
+    if (atomic_cmpxchg_acquire(owner, 0, 1))
+    {
+        mutex_unlock(mutex); 
+        return -EAGAIN; 
+    }
+
+    return FIFO_LOCK_MUTEX; 
+}
+
+
+/// @brief Release one side of a FIFO. 
+/// @param mutex mutex of the side. 
+/// @param owner owner word of the side. 
+/// @param lock  value returned by fifo_side_lock. 
+static void fifo_side_unlock(struct mutex* mutex, atomic_t* owner, int lock)
+{
+    fifo_unclaim(owner); 
+
+    if (lock == FIFO_LOCK_MUTEX)
+        mutex_unlock(mutex); 
+}
+
+
+int fifo_read_lock(FIFO_t* fifo)
+{
+    return fifo_side_lock(fifo, &(fifo->r_mutex), &(fifo->r_owner), &(fifo->r_openers)); 
+}
+
+
+int fifo_read_trylock(FIFO_t* fifo)
+{
+    return fifo_side_trylock(&(fifo->r_mutex), &(fifo->r_owner), &(fifo->r_openers)); 
+}
+
+
+void fifo_read_unlock(FIFO_t* fifo, int lock)
+{
+    fifo_side_unlock(&(fifo->r_mutex), &(fifo->r_owner), lock); 
+}
+
+
+int fifo_write_lock(FIFO_t* fifo)
+{
+    return fifo_side_lock(fifo, &(fifo->w_mutex), &(fifo->w_owner), &(fifo->w_openers)); 
+}
+
+
+int fifo_write_trylock(FIFO_t* fifo)
+{
+    return fifo_side_trylock(&(fifo->w_mutex), &(fifo->w_owner), &(fifo->w_openers)); 
+}
+
+
+void fifo_write_unlock(FIFO_t* fifo, int lock)
+{
+    fifo_side_unlock(&(fifo->w_mutex), &(fifo->w_owner), lock); 
+}
+
+
+// * _ SHARED RING _____________________________________________________________
+
+/// @brief Count a new mapping of a FIFO, when a mapping is split or copied. 
+/// @param vma the new mapping. 
+static void fifo_vm_open(struct vm_area_struct* vma)
+{
+    FIFO_t* fifo; 
+
+    fifo = vma->vm_private_data; 
+    atomic_inc(&(fifo->mapped)); 
+}
+
+
+/// @brief Drop a mapping of a FIFO. 
+/// @param vma the mapping going away. 
+static void fifo_vm_close(struct vm_area_struct* vma)
+{
+    FIFO_t* fifo; 
+
+    fifo = vma->vm_private_data; 
+    atomic_dec(&(fifo->mapped)); 
+}
+
+
+/// @brief Give the page backing a faulting address of a FIFO mapping. 
+/// @param vmf fault description, its page offset is relative to the file. 
+/// @return 0 with the page set, VM_FAULT_SIGBUS past the buffer. 
+static vm_fault_t fifo_vm_fault(struct vm_fault* vmf)
+{
+    FIFO_t*         fifo; 
+    struct page*    page; 
+    unsigned long   offset; 
+
+    fifo = vmf->vma->vm_private_data; 
+
+    // The buffer can't be replaced while mapped, no lock is needed to use it. 
+    if (vmf->pgoff == FIFO_MMAP_RING_PGOFF)
+        page = vmalloc_to_page(fifo->ring); 
+
+    else 
+    {
+        offset = (vmf->pgoff - FIFO_MMAP_DATA_PGOFF) << PAGE_SHIFT; 
+        if (offset >= fifo->size)
+            return VM_FAULT_SIGBUS; 
+
+        page = vmalloc_to_page(fifo->buffer + offset); 
     }
 
-    // Allocate buffer memory and set read/write index to 0. 
-    fifo->buffer = (char*)kmalloc(FIFO_BUFFER_SIZE, GFP_KERNEL); 
-    if (!fifo->buffer)
+    get_page(page); 
+    vmf->page = page; 
+    return 0; 
+}
+
+
+static const struct vm_operations_struct fifo_vm_ops = {
+    .open  = fifo_vm_open, 
+    .close = fifo_vm_close, 
+    .fault = fifo_vm_fault, 
+};
+
+
+int fifo_mmap_ring(FIFO_t* fifo, struct vm_area_struct* vma)
+{
+    unsigned long   pages; 
+
+    // Private copies of the cursors would never be seen by the other side. 
+    if (!(vma->vm_flags & VM_SHARED))
+        return -EINVAL; 
+
+    // Counting the mapping under map_lock keeps a resize, which holds it 
+    // while checking the count, from replacing the buffer under us. The side 
+    // mutexes are held across user copies, which fault and take the mmap 
+    // lock we run under. 
+    if (mutex_lock_interruptible(&(fifo->map_lock)))
+        return -ERESTARTSYS; 
+
+    pages = FIFO_MMAP_DATA_PGOFF + (PAGE_ALIGN(fifo->size) >> PAGE_SHIFT); 
+    if (vma->vm_pgoff >= pages || vma_pages(vma) > pages - vma->vm_pgoff)
+    {
+        mutex_unlock(&(fifo->map_lock)); 
+        return -EINVAL; 
+    }
+
+    // An overwriting writer moves the read cursor under the feet of a mapped 
+    // reader, which could never tell its bytes were replaced. In broadcast 
+    // mode, the read cursor belongs to the readers listed in the driver, and 
+    // in sharded mode the messages are not in this buffer. 
+    if (fifo->mode & (FIFO_MODE_OVERWRITE | FIFO_MODE_BROADCAST | FIFO_MODE_SHARDED))
+    {
+        mutex_unlock(&(fifo->map_lock)); 
+        return -EINVAL; 
+    }
+
+    atomic_inc(&(fifo->mapped)); 
+    mutex_unlock(&(fifo->map_lock)); 
+
+    vm_flags_set(vma, VM_DONTEXPAND | VM_DONTDUMP); 
+    vma->vm_private_data = fifo; 
+    vma->vm_ops = &fifo_vm_ops; 
+    return 0; 
+}
+
+
+// * _ BROADCAST READERS _______________________________________________________
+
+/// @brief Move every reader of a fifo back to the read cursor of the ring, 
+///        after it was reset or changed mode. Dropped readers get back in. 
+///        Called with readers_lock held. 
+/// @param fifo pointer to a fifo structure. 
+static void fifo_rewind_readers(FIFO_t* fifo)
+{
+    FIFO_file_t*    file; 
+
+    list_for_each_entry(file, &(fifo->readers), node)
+    {
+        WRITE_ONCE(file->r_cur, fifo->ring->r_cur); 
+        WRITE_ONCE(file->dropped, false); 
+    }
+}
+
+
+/// @brief Move the read cursor of the ring to the slowest broadcast mode 
+///        reader still listed, the space behind it goes back to the writers. 
+///        Called with readers_lock held. 
+/// @param fifo     pointer to a fifo structure. 
+/// @param fallback read cursor to use when every reader is gone or dropped. 
+static void fifo_follow_readers(FIFO_t* fifo, unsigned int fallback)
+{
+    FIFO_file_t*    file; 
+    unsigned int    r_cur; 
+    unsigned int    tail; 
+    bool            found; 
+
+    // Every reader is at or after the current cursor, the slowest one is the 
+    // closest to it. 
+    r_cur = fifo->ring->r_cur; 
+    tail = fallback; 
+    found = false; 
+    list_for_each_entry(file, &(fifo->readers), node)
+    {
+        if (file->dropped)
+            continue; 
+
+        if (!found || file->r_cur - r_cur < tail - r_cur)
+            tail = file->r_cur; 
+
+        found = true; 
+    }
+
+    // The readers are done with every byte before their cursor: they moved 
+    // it under the lock we hold, after copying. 
+    smp_store_release(&(fifo->ring->r_cur), tail); 
+}
+
+
+void fifo_attach(FIFO_t* fifo, FIFO_file_t* file)
+{
+    spin_lock(&(fifo->readers_lock)); 
+    file->r_cur = fifo->ring->r_cur; 
+    file->dropped = false; 
+    list_add_tail(&(file->node), &(fifo->readers)); 
+    spin_unlock(&(fifo->readers_lock)); 
+}
+
+
+void fifo_detach(FIFO_t* fifo, FIFO_file_t* file)
+{
+    // Without readers left, the data stays for the next one. 
+    spin_lock(&(fifo->readers_lock)); 
+    list_del_init(&(file->node)); 
+    if ((fifo->mode & FIFO_MODE_BROADCAST) && !file->dropped)
+        fifo_follow_readers(fifo, fifo->ring->r_cur); 
+
+    spin_unlock(&(fifo->readers_lock)); 
+    fifo_wake_writers(fifo); 
+}
+
+
+unsigned int* fifo_read_cursor(FIFO_t* fifo, FIFO_file_t* file)
+{
+    // A file only open for writing has no cursor of its own. 
+    if ((READ_ONCE(fifo->mode) & FIFO_MODE_BROADCAST) && !list_empty(&(file->node)))
+        return &(file->r_cur); 
+
+    return &(fifo->ring->r_cur); 
+}
+
+
+bool fifo_drop_readers(FIFO_t* fifo)
+{
+    FIFO_file_t*    file; 
+    unsigned int    max_lag; 
+    unsigned int    r_cur; 
+    unsigned int    w_cur; 
+    bool            dropped; 
+
+    max_lag = READ_ONCE(fifo->max_lag); 
+    if (!(READ_ONCE(fifo->mode) & FIFO_MODE_BROADCAST) || !max_lag)
+        return false; 
+
+    // Load the write cursor under the lock: every reader cursor we find there 
+    // was moved behind a write cursor at most that far. 
+    dropped = false; 
+    spin_lock(&(fifo->readers_lock)); 
+    r_cur = fifo->ring->r_cur; 
+    w_cur = READ_ONCE(fifo->ring->w_cur); 
+    list_for_each_entry(file, &(fifo->readers), node)
+    {
+        if (file->dropped || w_cur - file->r_cur <= max_lag)
+            continue; 
+
+        WRITE_ONCE(file->dropped, true); 
+        dropped = true; 
+        INFO_DEBUG("[FIFO] device %u dropped a reader of process %d.\n", fifo->minor, file->pid);
+    }
+
+    // Once every reader is dropped, nothing written so far will be read. 
+    if (dropped)
+        fifo_follow_readers(fifo, w_cur); 
+
+    spin_unlock(&(fifo->readers_lock)); 
+
+    // The dropped readers learn it from their next read, even asleep. 
+    if (dropped)
+        wake_up_interruptible_all(&(fifo->r_wait)); 
+
+    return READ_ONCE(fifo->ring->r_cur) != r_cur; 
+}
+
+
+bool fifo_readers_lagging(FIFO_t* fifo)
+{
+    FIFO_file_t*    file; 
+    unsigned int    max_lag; 
+    unsigned int    w_cur; 
+    bool            lagging; 
+
+    max_lag = READ_ONCE(fifo->max_lag); 
+    if (!(READ_ONCE(fifo->mode) & FIFO_MODE_BROADCAST) || !max_lag)
+        return false; 
+
+    // The slowest reader holds the read cursor of the ring, dropping any 
+    // reader past the limit moves it. 
+    lagging = false; 
+    spin_lock(&(fifo->readers_lock)); 
+    w_cur = READ_ONCE(fifo->ring->w_cur); 
+    list_for_each_entry(file, &(fifo->readers), node)
+    {
+        if (!file->dropped && w_cur - file->r_cur > max_lag)
+        {
+            lagging = true; 
+            break; 
+        }
+    }
+
+    spin_unlock(&(fifo->readers_lock)); 
+    return lagging; 
+}
+
+
+// * _ FIFO MANAGEMENT _________________________________________________________
+
+
+/// @brief Take both sides of a FIFO through their mutex, draining lockless 
+///        callers as well. 
+/// @param fifo pointer to a fifo structure. 
+/// @return 0 once both sides are owned, -ERESTARTSYS if interrupted. 
+static int fifo_lock_both(FIFO_t* fifo)
+{
+    if (fifo_side_lock(fifo, &(fifo->r_mutex), &(fifo->r_owner), NULL) < 0)
+        return -ERESTARTSYS;
+
+    if (fifo_side_lock(fifo, &(fifo->w_mutex), &(fifo->w_owner), NULL) < 0)
+    {
+        fifo_side_unlock(&(fifo->r_mutex), &(fifo->r_owner), FIFO_LOCK_MUTEX); 
+        return -ERESTARTSYS;
+    }
+
+    return 0; 
+}
+
+
+/// @brief Release both sides of a FIFO taken with fifo_lock_both. 
+/// @param fifo pointer to a fifo structure. 
+static void fifo_unlock_both(FIFO_t* fifo)
+{
+    fifo_side_unlock(&(fifo->w_mutex), &(fifo->w_owner), FIFO_LOCK_MUTEX); 
+    fifo_side_unlock(&(fifo->r_mutex), &(fifo->r_owner), FIFO_LOCK_MUTEX); 
+}
+
+
+/// @brief Count the bytes of a buffer from vmalloc_huge() backed by 2MB 
+///        pages: each 2MB aligned part whose every page follows the previous 
+///        one in a 2MB aligned physical block. 
+/// @param buffer buffer from vmalloc_huge(). 
+/// @param size   buffer size in bytes. 
+/// @return the number of bytes, a multiple of 2MB. 
+static unsigned int fifo_huge_bytes(unsigned char* buffer, unsigned int size)
+{
+    unsigned long   first; 
+    unsigned int    offset; 
+    unsigned int    page; 
+    unsigned int    huge; 
+
+    huge = 0; 
+    if (!IS_ALIGNED((unsigned long)buffer, PMD_SIZE))
+        return 0; 
+
+    for (offset = 0; offset + PMD_SIZE <= size; offset += PMD_SIZE)
+    {
+        first = vmalloc_to_pfn(buffer + offset); 
+        if (!IS_ALIGNED(first, PMD_SIZE >> PAGE_SHIFT))
+            continue; 
+
+        for (page = 1; page < (PMD_SIZE >> PAGE_SHIFT); page += 1)
+        {
+            if (vmalloc_to_pfn(buffer + offset + page * PAGE_SIZE) != first + page)
+                break; 
+        }
+
+        if (page == (PMD_SIZE >> PAGE_SHIFT))
+            huge += PMD_SIZE; 
+    }
+
+    return huge; 
+}
+
+
+/// @brief Allocate a zeroed buffer, from 2MB pages when huge_pages is set and 
+///        it spans at least one of them, from 4KB pages otherwise. Either way, 
+///        the mappings fault it in page by page. 
+/// @param size buffer size in bytes. 
+/// @param node NUMA node to allocate on, NUMA_NO_NODE for any. 
+/// @param huge set to the number of bytes backed by 2MB pages. 
+/// @return the buffer, NULL if no memory is left. 
+static unsigned char* fifo_buffer_alloc(unsigned int size, int node, unsigned int* huge)
+{
+    unsigned char* buffer; 
+
+    // vmalloc_huge() takes its pages from the node we run on, and falls back 
+    // to 4KB pages by itself when no 2MB page is free. Only the 2MB pages it 
+    // got are counted, checked once now rather than on every sysfs read. 
+    if (READ_ONCE(huge_pages) && size >= PMD_SIZE && (node == NUMA_NO_NODE || node == numa_node_id()))
+    {
+        buffer = vmalloc_huge(size, GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN); 
+        if (buffer)
+        {
+            *huge = fifo_huge_bytes(buffer, size); 
+            return buffer; 
+        }
+    }
+
+    // The 4KB page allocator never backs a buffer with 2MB pages. 
+    *huge = 0; 
+    return vzalloc_node(size, node); 
+}
+
+
+unsigned int fifo_round_size(unsigned int size)
+{
+    if (size < FIFO_BUFFER_MIN_SIZE || size > FIFO_BUFFER_MAX_SIZE)
+        return 0; 
+
+    return roundup_pow_of_two(size); 
+}
+
+
+/// @brief Set the watermarks of a fifo to their defaults for its size. 
+/// @param fifo pointer to a fifo structure. 
+static void fifo_default_watermarks(FIFO_t* fifo)
+{
+    WRITE_ONCE(fifo->lowat, fifo->size - fifo->size / FIFO_LOW_WATERMARK_DIV); 
+    WRITE_ONCE(fifo->hiwat, FIFO_HIGH_WATERMARK); 
+}
+
+
+int init_fifo(FIFO_t* fifo, unsigned int minor)
+{
+    dev_t   dev_minor; 
+
+    dev_minor = MKDEV(fifo_major, minor); 
+
+    // Initialize mutexes and cursors before the device can be reached. 
+    fifo->minor = minor; 
+    fifo->openers = 0; 
+    fifo->mode = overwrite ? FIFO_MODE_OVERWRITE : FIFO_MODE_STREAM; 
+    mutex_init(&(fifo->r_mutex)); 
+    mutex_init(&(fifo->w_mutex)); 
+    atomic_set(&(fifo->r_owner), 0); 
+    atomic_set(&(fifo->w_owner), 0); 
+    atomic_set(&(fifo->r_openers), 0); 
+    atomic_set(&(fifo->w_openers), 0); 
+    init_waitqueue_head(&(fifo->r_wait)); 
+    init_waitqueue_head(&(fifo->w_wait)); 
+    atomic_set(&(fifo->mapped), 0); 
+    mutex_init(&(fifo->map_lock)); 
+    spin_lock_init(&(fifo->readers_lock)); 
+    INIT_LIST_HEAD(&(fifo->readers)); 
+    fifo->max_lag = FIFO_MAX_LAG; 
+    fifo->node = NUMA_NO_NODE; 
+    fifo->r_cpu = -1; 
+    fifo->w_cpu = -1; 
+    fifo->shards = NULL; 
+    if (percpu_init_rwsem(&(fifo->shard_sem)))
+        return -ENOMEM; 
+
+    // Allocate the zeroed control page and buffer from vmalloc memory, the 
+    // mappings fault them in page by page. Large buffers don't need 
+    // contiguous pages this way. 
+    fifo->size = fifo_round_size(buffer_size); 
+    fifo->mask = fifo->size - 1; 
+    fifo->ring = vmalloc_user(PAGE_SIZE); 
+    fifo->buffer = fifo_buffer_alloc(fifo->size, fifo->node, &(fifo->huge)); 
+    fifo->stats = alloc_percpu(FIFO_counters_t); 
+    if (!fifo->ring || !fifo->buffer || !fifo->stats)
     {
         ERR_DEBUG("[FIFO] device %d buffer not allocated correctly, abort.\n", minor);
-        cdev_del(&(fifo->cdev));
+        vfree(fifo->ring); 
+        vfree(fifo->buffer); 
+        free_percpu(fifo->stats); 
+        percpu_free_rwsem(&(fifo->shard_sem)); 
         return -ENOMEM; 
     }
 
-    // Create the device class device. 
+    fifo->ring->size = fifo->size; 
+    fifo_default_watermarks(fifo); 
+
+    // Create the device class device, the sys/class functions find the 
+    // FIFO_t structure back through its driver data. 
     fifo->class_device = device_create(
         fifo_class, 
         NULL, 
         dev_minor, 
-        NULL, 
-        "fifo%c", 
-        ('0' + minor)
+        fifo, 
+        "fifo%u", 
+        minor
     );
 
     if (IS_ERR(fifo->class_device))
     {
-        kfree(fifo->buffer); 
-        cdev_del(&(fifo->cdev));
+        vfree(fifo->ring); 
+        vfree(fifo->buffer); 
+        free_percpu(fifo->stats); 
+        percpu_free_rwsem(&(fifo->shard_sem)); 
         return PTR_ERR(fifo->class_device);
     }
 
-    // Create the buffer view, free and used space left sys/class file. 
+    // Create the buffer view, free and used space left and stat sys/class file. 
     device_create_file(fifo->class_device, &dev_attr_view);
     device_create_file(fifo->class_device, &dev_attr_free);
     device_create_file(fifo->class_device, &dev_attr_used);
-    
-    // Initialize mutexes and cursors. 
-    mutex_init(&(fifo->r_mutex)); 
-    mutex_init(&(fifo->w_mutex)); 
-    fifo->r_cur = -1; 
-    fifo->w_cur = 0; 
+    device_create_file(fifo->class_device, &dev_attr_stat);
+    device_create_file(fifo->class_device, &dev_attr_stats);
+    device_create_file(fifo->class_device, &dev_attr_dropped);
+    device_create_file(fifo->class_device, &dev_attr_readers);
+    device_create_file(fifo->class_device, &dev_attr_shards);
+    device_create_file(fifo->class_device, &dev_attr_node);
+    device_create_file(fifo->class_device, &dev_attr_cpus);
+    device_create_file(fifo->class_device, &dev_attr_backing);
 
-    // Fill the buffer with zeros. 
-    for (i = 0; i < FIFO_BUFFER_SIZE; i += 1)
-        fifo->buffer[i] = 0; 
+    // The wait latency histogram is only a debugging aid, the device works 
+    // without it. 
+    fifo->debugfs = debugfs_create_file(
+        dev_name(fifo->class_device), 0444, fifo_debugfs, fifo, &fifo_hist_fops
+    ); 
     
     INFO_DEBUG("[FIFO] device %d is correctly registered.\n", minor);
     return 0; 
 }
 
 
-int fifo_reset(unsigned int minor)
+int fifo_create(int minor)
 {
-    int i; 
+    FIFO_t* fifo; 
+    int     start; 
+    int     end; 
+    int     retval; 
+
+    if (minor >= FIFO_MAX_DEVICES)
+        return -EINVAL; 
+
+    // Either take the wanted minor or the first free one. 
+    start = minor < 0 ? 0 : minor; 
+    end = minor < 0 ? FIFO_MAX_DEVICES : minor + 1; 
+
+    fifo = kzalloc(sizeof(FIFO_t), GFP_KERNEL); 
+    if (!fifo)
+        return -ENOMEM; 
+
+    mutex_lock(&fifo_idr_mutex); 
+
+    // Reserve the minor first, the device is only published once ready. 
+    retval = idr_alloc(&fifo_idr, NULL, start, end, GFP_KERNEL); 
+    if (retval < 0)
+    {
+        mutex_unlock(&fifo_idr_mutex); 
+        kfree(fifo); 
+        return (retval == -ENOSPC && minor >= 0) ? -EEXIST : retval; 
+    }
+
+    minor = retval; 
+    retval = init_fifo(fifo, minor); 
+    if (retval)
+    {
+        idr_remove(&fifo_idr, minor); 
+        mutex_unlock(&fifo_idr_mutex); 
+        kfree(fifo); 
+        return retval; 
+    }
+
+    idr_replace(&fifo_idr, fifo, minor); 
+    mutex_unlock(&fifo_idr_mutex); 
+    return minor; 
+}
 
-    // Lock the read and write mutex while resetting the buffer. 
-    if (mutex_lock_interruptible(&(fifos[minor].r_mutex)))
-        return -ERESTARTSYS;
 
-    if (mutex_lock_interruptible(&(fifos[minor].w_mutex)))
+int fifo_destroy(unsigned int minor)
+{
+    FIFO_t* fifo; 
+
+    mutex_lock(&fifo_idr_mutex); 
+
+    fifo = idr_find(&fifo_idr, minor); 
+    if (!fifo)
+    {
+        mutex_unlock(&fifo_idr_mutex); 
+        return -ENODEV; 
+    }
+
+    // No file operation can run on a closed device, and no one can open it 
+    // anymore once its slot is empty. The minor stays reserved until the 
+    // sysfs and debugfs entries named after it are gone, so a device created 
+    // again on it can't clash with them. 
+    if (fifo->openers)
+    {
+        mutex_unlock(&fifo_idr_mutex); 
+        return -EBUSY; 
+    }
+
+    idr_replace(&fifo_idr, NULL, minor); 
+    mutex_unlock(&fifo_idr_mutex); 
+
+    // Removing the class device waits for the sys/class functions running on 
+    // it, nothing uses the structure after that. 
+    debugfs_remove(fifo->debugfs); 
+    device_destroy(fifo_class, MKDEV(fifo_major, minor)); 
+    vfree(fifo->ring); 
+    vfree(fifo->buffer); 
+    free_percpu(fifo->stats); 
+    fifo_shard_destroy(fifo); 
+    percpu_free_rwsem(&(fifo->shard_sem)); 
+    kfree(fifo); 
+
+    mutex_lock(&fifo_idr_mutex); 
+    idr_remove(&fifo_idr, minor); 
+    mutex_unlock(&fifo_idr_mutex); 
+
+    INFO_DEBUG("[FIFO] device %d is correctly unregistered.\n", minor);
+    return 0; 
+}
+
+
+FIFO_t* fifo_get(unsigned int minor)
+{
+    FIFO_t* fifo; 
+
+    mutex_lock(&fifo_idr_mutex); 
+
+    fifo = idr_find(&fifo_idr, minor); 
+    if (fifo)
+        fifo->openers += 1; 
+
+    mutex_unlock(&fifo_idr_mutex); 
+    return fifo; 
+}
+
+
+void fifo_put(FIFO_t* fifo)
+{
+    mutex_lock(&fifo_idr_mutex); 
+    fifo->openers -= 1; 
+    mutex_unlock(&fifo_idr_mutex); 
+}
+
+
+int fifo_reset(FIFO_t* fifo)
+{
+    // Take both sides while resetting the buffer. 
+    if (fifo_lock_both(fifo))
         return -ERESTARTSYS;
 
     // Empty the fifo buffer. 
-    for (i = 0; i < FIFO_BUFFER_SIZE; i += 1)
-        fifos[minor].buffer[i] = 0; 
+    memset(fifo->buffer, 0, fifo->size); 
 
-    // Reset cursor position. 
-    fifos[minor].r_cur = -1; 
-    fifos[minor].w_cur = 0; 
+    // Reset cursor position, the readers' ones as well. 
+    spin_lock(&(fifo->readers_lock)); 
+    ring_rewind(fifo->ring); 
+    fifo_rewind_readers(fifo); 
+    spin_unlock(&(fifo->readers_lock)); 
 
-    // Unlock both mutexes. 
-    mutex_unlock(&(fifos[minor].r_mutex)); 
-    mutex_unlock(&(fifos[minor].w_mutex)); 
+    // The writers of a sharded device don't take the write side. 
+    if (fifo->mode & FIFO_MODE_SHARDED)
+    {
+        percpu_down_write(&(fifo->shard_sem)); 
+        fifo_shard_reset(fifo); 
+        percpu_up_write(&(fifo->shard_sem)); 
+    }
+
+    trace_fifo_reset(fifo->minor, fifo->size); 
+
+    // Release both sides and wake up every writer waiting for space, the 
+    // whole buffer is free. 
+    fifo_unlock_both(fifo); 
+    wake_up_interruptible_all(&(fifo->w_wait)); 
     return 0; 
 }
 
 
-int fifo_get_free_space(int minor)
+int fifo_resize(FIFO_t* fifo, unsigned int size)
 {
-    int r_cur; 
-    int w_cur;
-    int free_space; 
+    unsigned char*  buffer; 
+    unsigned char*  old_buffer; 
+    unsigned int    huge; 
+
+    size = fifo_round_size(size); 
+    if (!size)
+        return -EINVAL; 
 
-    // Check if the minor number is available. 
-    if (minor > FIFO_DEV_COUNT - 1)
+    // Allocate the new buffer before taking the device, to not stall readers 
+    // and writers during the allocation. 
+    buffer = fifo_buffer_alloc(size, READ_ONCE(fifo->node), &huge); 
+    if (!buffer)
+        return -ENOMEM; 
+
+    if (fifo_lock_both(fifo))
     {
-        ERR_DEBUG("[FIFO] Trying to access an unregistered device.\n"); 
-        return -ENODEV; 
+        vfree(buffer); 
+        return -ERESTARTSYS;
     }
-    
-    r_cur = fifos[minor].r_cur; 
-    w_cur = fifos[minor].w_cur;
-    free_space = 0; 
 
-    // If the read cursor is at it's initialization position, the buffer is 
-    // empty or the write cursor has moved. Avoid an infinite loop. 
-    if (r_cur < 0)
-        return FIFO_BUFFER_SIZE - w_cur; 
+    // Only an empty device can be resized, its content would not fit in a 
+    // smaller buffer and would be split at the wrong place in a larger one. 
+    // A mapped buffer can't be replaced under the processes using it either. 
+    // The rings of a sharded device are checked once their writers are out. 
+    percpu_down_write(&(fifo->shard_sem)); 
+    mutex_lock(&(fifo->map_lock)); 
+    if (fifo->ring->w_cur != fifo->ring->r_cur || atomic_read(&(fifo->mapped)) || fifo_shard_used(fifo))
+    {
+        mutex_unlock(&(fifo->map_lock)); 
+        percpu_up_write(&(fifo->shard_sem)); 
+        fifo_unlock_both(fifo); 
+        vfree(buffer); 
+        return -EBUSY; 
+    }
+
+    trace_fifo_resize(fifo->minor, fifo->size, size); 
+
+    old_buffer = fifo->buffer; 
+    fifo->buffer = buffer; 
+    spin_lock(&(fifo->readers_lock)); 
+    ring_rewind(fifo->ring); 
+    fifo_rewind_readers(fifo); 
+    spin_unlock(&(fifo->readers_lock)); 
+    WRITE_ONCE(fifo->mask, size - 1); 
+    WRITE_ONCE(fifo->size, size); 
+    fifo->ring->size = size; 
+    fifo->huge = huge; 
+    fifo_default_watermarks(fifo); 
+    mutex_unlock(&(fifo->map_lock)); 
+
+    // The rings of each CPU take the new size with their next write. 
+    fifo_shard_release(fifo); 
+    percpu_up_write(&(fifo->shard_sem)); 
+
+    // Every writer may fit now, or learn its message never will. 
+    fifo_unlock_both(fifo); 
+    vfree(old_buffer); 
+    wake_up_interruptible_all(&(fifo->w_wait)); 
 
-    // Increment the space_left variable until the write cursor reach the read 
-    // cursor. 
-    while (w_cur != r_cur)
+    INFO_DEBUG("[FIFO] device %u resized to %u bytes.\n", fifo->minor, size);
+    return size; 
+}
+
+
+int fifo_set_mode(FIFO_t* fifo, unsigned int mode)
+{
+    int retval; 
+
+    // A writer dropping the oldest data would move the read cursor past the 
+    // broadcast readers. Messages from several CPUs can only be told apart 
+    // whole, and the rings of each CPU have a single reader. 
+    if ((mode & ~FIFO_MODE_MASK) || 
+        ((mode & FIFO_MODE_OVERWRITE) && (mode & FIFO_MODE_BROADCAST)) || 
+        ((mode & FIFO_MODE_SHARDED) && 
+         (!(mode & FIFO_MODE_RECORD) || (mode & (FIFO_MODE_OVERWRITE | FIFO_MODE_BROADCAST)))) || 
+        ((mode & FIFO_MODE_ORDERED) && !(mode & FIFO_MODE_SHARDED)))
+        return -EINVAL; 
+
+    if (fifo_lock_both(fifo))
+        return -ERESTARTSYS;
+
+    // Keep the writers of a sharded device out as well. 
+    percpu_down_write(&(fifo->shard_sem)); 
+
+    // Messages already stored could not be read back in the other mode, and 
+    // mapped readers don't expect the read cursor to be moved for them. 
+    mutex_lock(&(fifo->map_lock)); 
+    retval = 0; 
+    if (fifo->ring->w_cur != fifo->ring->r_cur || fifo_shard_used(fifo) || 
+        ((mode & (FIFO_MODE_OVERWRITE | FIFO_MODE_BROADCAST | FIFO_MODE_SHARDED)) && 
+         atomic_read(&(fifo->mapped))))
+        retval = -EBUSY; 
+
+    else if (mode & FIFO_MODE_SHARDED)
+        retval = fifo_shard_init(fifo); 
+
+    if (retval)
     {
-        w_cur = (w_cur + 1) % FIFO_BUFFER_SIZE; 
-        free_space += 1; 
+        mutex_unlock(&(fifo->map_lock)); 
+        percpu_up_write(&(fifo->shard_sem)); 
+        fifo_unlock_both(fifo); 
+        return retval; 
     }
-    
-    return free_space + 1; 
+
+    // The rings of each CPU are only kept while they are used. 
+    if (!(mode & FIFO_MODE_SHARDED))
+        fifo_shard_release(fifo); 
+
+    // The readers start from the ring cursor in broadcast mode, and closing 
+    // one only moves it in that mode. 
+    spin_lock(&(fifo->readers_lock)); 
+    WRITE_ONCE(fifo->mode, mode); 
+    fifo_rewind_readers(fifo); 
+    spin_unlock(&(fifo->readers_lock)); 
+    mutex_unlock(&(fifo->map_lock)); 
+    percpu_up_write(&(fifo->shard_sem)); 
+    fifo_unlock_both(fifo); 
+
+    // Readers sleeping on the main ring read from the rings of each CPU now, 
+    // or the other way around. 
+    wake_up_interruptible_all(&(fifo->r_wait)); 
+
+    INFO_DEBUG("[FIFO] device %u mode set to %u.\n", fifo->minor, mode);
+    return 0; 
+}
+
+
+int fifo_set_watermarks(FIFO_t* fifo, unsigned int low, unsigned int high)
+{
+    // Take both sides so the size can't change while we check against it. 
+    if (fifo_lock_both(fifo))
+        return -ERESTARTSYS;
+
+    // A low watermark of the size would wake writers on a full FIFO, a high 
+    // watermark above it would never wake readers. 
+    if (low >= fifo->size || !high || high > fifo->size)
+    {
+        fifo_unlock_both(fifo); 
+        return -EINVAL; 
+    }
+
+    WRITE_ONCE(fifo->lowat, low); 
+    WRITE_ONCE(fifo->hiwat, high); 
+    fifo_unlock_both(fifo); 
+
+    // Sleepers may already be past the new watermarks. 
+    fifo_notify(fifo); 
+
+    INFO_DEBUG("[FIFO] device %u watermarks set to %u and %u.\n", fifo->minor, low, high);
+    return 0; 
+}
+
+
+void fifo_set_max_lag(FIFO_t* fifo, unsigned int max_lag)
+{
+    WRITE_ONCE(fifo->max_lag, max_lag); 
+
+    // Writers sleeping for space may get it from the readers dropped now. 
+    if (fifo_drop_readers(fifo))
+        fifo_wake_writers(fifo); 
+
+    INFO_DEBUG("[FIFO] device %u lag limit set to %u.\n", fifo->minor, max_lag);
+}
+
+
+int fifo_set_node(FIFO_t* fifo, int node)
+{
+    unsigned char*  buffer; 
+    unsigned char*  old_buffer; 
+    unsigned int    size; 
+    unsigned int    huge; 
+
+    if (node != NUMA_NO_NODE && (node < 0 || node >= nr_node_ids || !node_online(node)))
+        return -EINVAL; 
+
+    // Allocate the new buffer before taking the device, like a resize. 
+    size = READ_ONCE(fifo->size); 
+    buffer = fifo_buffer_alloc(size, node, &huge); 
+    if (!buffer)
+        return -ENOMEM; 
+
+    if (fifo_lock_both(fifo))
+    {
+        vfree(buffer); 
+        return -ERESTARTSYS;
+    }
+
+    // The pages of a mapped buffer can't be replaced under the processes 
+    // using them. The rings of a sharded device already are on the node of 
+    // their CPU, only the main ring moves. 
+    mutex_lock(&(fifo->map_lock)); 
+    if (size != fifo->size || atomic_read(&(fifo->mapped)))
+    {
+        mutex_unlock(&(fifo->map_lock)); 
+        fifo_unlock_both(fifo); 
+        vfree(buffer); 
+        return -EBUSY; 
+    }
+
+    // The cursors are masked to index the buffer, each byte keeps its place. 
+    memcpy(buffer, fifo->buffer, size); 
+    old_buffer = fifo->buffer; 
+    fifo->buffer = buffer; 
+    fifo->huge = huge; 
+    WRITE_ONCE(fifo->node, node); 
+    mutex_unlock(&(fifo->map_lock)); 
+    fifo_unlock_both(fifo); 
+    vfree(old_buffer); 
+
+    INFO_DEBUG("[FIFO] device %u buffer moved to node %d.\n", fifo->minor, node);
+    return 0; 
+}
+
+
+int fifo_next_size(FIFO_t* fifo, FIFO_file_t* file)
+{
+    unsigned int*   cursor; 
+    unsigned int    r_cur; 
+    unsigned int    w_cur; 
+    unsigned int    used; 
+    int             len; 
+    int             lock; 
+
+    // Own the read side so the header can't be consumed while we read it. 
+    lock = fifo_read_lock(fifo); 
+    if (lock < 0)
+        return lock; 
+
+    if (READ_ONCE(file->dropped))
+    {
+        fifo_read_unlock(fifo, lock); 
+        return -EPIPE; 
+    }
+
+    if (fifo->mode & FIFO_MODE_SHARDED)
+    {
+        len = fifo_shard_next_size(fifo); 
+        fifo_read_unlock(fifo, lock); 
+        return len; 
+    }
+
+    // In overwrite mode, a writer may drop the message while we read its 
+    // header, look at the next one then. 
+    cursor = fifo_read_cursor(fifo, file); 
+    do
+    {
+        r_cur = smp_load_acquire(cursor); 
+        w_cur = smp_load_acquire(&(fifo->ring->w_cur)); 
+        used = ring_used(r_cur, w_cur, fifo->size); 
+        len = used; 
+
+        if ((fifo->mode & FIFO_MODE_RECORD) && used)
+            len = fifo_record_length(fifo, r_cur, used); 
+    }
+    while (len < 0 && READ_ONCE(*cursor) != r_cur); 
+
+    fifo_read_unlock(fifo, lock); 
+    return len; 
+}
+
+
+int fifo_record_length(FIFO_t* fifo, unsigned int r_cur, unsigned int used)
+{
+    return ring_record_length(fifo->buffer, fifo->size, r_cur, used); 
+}
+
+
+int fifo_overwrite(FIFO_t* fifo, unsigned int w_cur, size_t len)
+{
+    unsigned int    dropped; 
+    unsigned int    msgs; 
+
+    if (len > fifo->size)
+        return -EMSGSIZE; 
+
+    msgs = ring_overwrite(
+        fifo->ring, fifo->buffer, fifo->size, w_cur, len, 
+        fifo->mode & FIFO_MODE_RECORD, &dropped
+    ); 
+
+    FIFO_COUNT(fifo, dropped, dropped); 
+    FIFO_COUNT(fifo, dropped_msgs, msgs); 
+    return 0; 
+}
+
+
+int fifo_consume(FIFO_t* fifo, FIFO_file_t* file, unsigned int r_cur, unsigned int r_next)
+{
+    if (!(fifo->mode & FIFO_MODE_BROADCAST))
+        return ring_consume(fifo->ring, r_cur, r_next, fifo->mode & FIFO_MODE_OVERWRITE) ? 0 : -EAGAIN; 
+
+    // A dropped reader may have copied bytes a writer was replacing. Only the 
+    // slowest reader holds the space back, the others just move their cursor. 
+    spin_lock(&(fifo->readers_lock)); 
+    if (file->dropped)
+    {
+        spin_unlock(&(fifo->readers_lock)); 
+        return -EPIPE; 
+    }
+
+    WRITE_ONCE(file->r_cur, r_next); 
+    if (r_cur == fifo->ring->r_cur)
+        fifo_follow_readers(fifo, r_cur); 
+
+    spin_unlock(&(fifo->readers_lock)); 
+    return 0; 
+}
+
+
+void fifo_peek(FIFO_t* fifo, unsigned int cur, void* dst, unsigned int len)
+{
+    ring_peek(fifo->buffer, fifo->size, cur, dst, len); 
+}
+
+
+void fifo_poke(FIFO_t* fifo, unsigned int cur, const void* src, unsigned int len)
+{
+    ring_poke(fifo->buffer, fifo->size, cur, src, len); 
+}
+
+
+int fifo_copy_to_user(FIFO_t* fifo, unsigned int cur, void __user* dst, unsigned int len)
+{
+    unsigned int pos; 
+    unsigned int first_seg; 
+
+    pos = cur & fifo->mask; 
+    first_seg = min(len, fifo->size - pos); 
+
+    if (copy_to_user(dst, fifo->buffer + pos, first_seg))
+        return -EFAULT; 
+
+    if (copy_to_user((unsigned char __user*)dst + first_seg, fifo->buffer, len - first_seg))
+        return -EFAULT; 
+
+    return 0; 
+}
+
+
+int fifo_copy_from_user(FIFO_t* fifo, unsigned int cur, const void __user* src, unsigned int len)
+{
+    unsigned int pos; 
+    unsigned int first_seg; 
+
+    pos = cur & fifo->mask; 
+    first_seg = min(len, fifo->size - pos); 
+
+    if (copy_from_user(fifo->buffer + pos, src, first_seg))
+        return -EFAULT; 
+
+    if (copy_from_user(fifo->buffer, (const unsigned char __user*)src + first_seg, len - first_seg))
+        return -EFAULT; 
+
+    return 0; 
+}
+
+
+void fifo_get_stat(FIFO_t* fifo, FIFO_stat_t* stat)
+{
+    unsigned int r_cur; 
+    unsigned int w_cur; 
+
+    // Load the read cursor first: the write cursor loaded afterwards can't be 
+    // behind it, so the difference never goes negative. The reader may have 
+    // moved on and let the writer refill the buffer in between, which is why 
+    // the used space is capped to the buffer size. 
+    r_cur = smp_load_acquire(&(fifo->ring->r_cur)); 
+    w_cur = READ_ONCE(fifo->ring->w_cur); 
+
+    stat->capacity = READ_ONCE(fifo->size); 
+    stat->used = ring_used(r_cur, w_cur, stat->capacity); 
+    stat->free = stat->capacity - stat->used; 
+    stat->r_pos = r_cur & (stat->capacity - 1); 
+    stat->w_pos = w_cur & (stat->capacity - 1); 
+}
+
+
+unsigned int fifo_read_threshold(FIFO_t* fifo)
+{
+    if (READ_ONCE(fifo->mode) & FIFO_MODE_RECORD)
+        return 1; 
+
+    return READ_ONCE(fifo->hiwat); 
+}
+
+
+bool fifo_readable(FIFO_t* fifo)
+{
+    return fifo_get_used_space(fifo) >= fifo_read_threshold(fifo); 
+}
+
+
+unsigned int fifo_file_used(FIFO_t* fifo, FIFO_file_t* file)
+{
+    unsigned int*   cursor; 
+
+    cursor = fifo_read_cursor(fifo, file); 
+    if (cursor == &(fifo->ring->r_cur))
+        return fifo_get_used_space(fifo); 
+
+    // Only this reader moves its cursor, the write cursor is never behind it. 
+    return ring_used(READ_ONCE(*cursor), smp_load_acquire(&(fifo->ring->w_cur)), READ_ONCE(fifo->size)); 
+}
+
+
+bool fifo_file_readable(FIFO_t* fifo, FIFO_file_t* file)
+{
+    return READ_ONCE(file->dropped) || fifo_file_used(fifo, file) >= fifo_read_threshold(fifo); 
+}
+
+
+bool fifo_writable(FIFO_t* fifo)
+{
+    return fifo_get_used_space(fifo) <= READ_ONCE(fifo->lowat); 
+}
+
+
+void fifo_wake_readers(FIFO_t* fifo)
+{
+    if (wq_has_sleeper(&(fifo->r_wait)) && fifo_readable(fifo))
+        wake_up_interruptible_poll(&(fifo->r_wait), EPOLLIN | EPOLLRDNORM); 
+}
+
+
+void fifo_wake_writers(FIFO_t* fifo)
+{
+    // Stream writers wait exclusively, so this only wakes one of them, with 
+    // every writer waiting for room for a message. The stream writer passes 
+    // the wake up on once done, if there is still room. 
+    if (wq_has_sleeper(&(fifo->w_wait)) && fifo_writable(fifo))
+        wake_up_interruptible_poll(&(fifo->w_wait), EPOLLOUT | EPOLLWRNORM); 
+}
+
+
+void fifo_notify(FIFO_t* fifo)
+{
+    fifo_wake_readers(fifo); 
+    fifo_wake_writers(fifo); 
+}
+
+
+void fifo_count_wait(FIFO_t* fifo, u64 start)
+{
+    u64             waited; 
+    unsigned long   us; 
+    unsigned int    bucket; 
+
+    waited = ktime_get_ns() - start; 
+    us = div_u64(waited, NSEC_PER_USEC); 
+    bucket = us < 2 ? 0 : min_t(unsigned int, ilog2(us), FIFO_HIST_BUCKETS - 1); 
+
+    FIFO_COUNT(fifo, blocked_ns, waited); 
+    FIFO_COUNT(fifo, wait_hist[bucket], 1); 
+}
+
+
+void fifo_get_counters(FIFO_t* fifo, FIFO_counters_t* total)
+{
+    FIFO_counters_t*    counters; 
+    int                 cpu; 
+    int                 i; 
+
+    memset(total, 0, sizeof(FIFO_counters_t)); 
+
+    for_each_possible_cpu(cpu)
+    {
+        counters = per_cpu_ptr(fifo->stats, cpu); 
+
+        total->r_bytes += READ_ONCE(counters->r_bytes); 
+        total->w_bytes += READ_ONCE(counters->w_bytes); 
+        total->r_ops += READ_ONCE(counters->r_ops); 
+        total->w_ops += READ_ONCE(counters->w_ops); 
+        total->empty += READ_ONCE(counters->empty); 
+        total->full += READ_ONCE(counters->full); 
+        total->contended += READ_ONCE(counters->contended); 
+        total->blocked_ns += READ_ONCE(counters->blocked_ns); 
+        total->dropped += READ_ONCE(counters->dropped); 
+        total->dropped_msgs += READ_ONCE(counters->dropped_msgs); 
+
+        for (i = 0; i < FIFO_HIST_BUCKETS; i += 1)
+            total->wait_hist[i] += READ_ONCE(counters->wait_hist[i]); 
+    }
+}
+
+
+void fifo_reset_counters(FIFO_t* fifo)
+{
+    int cpu; 
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(fifo->stats, cpu), 0, sizeof(FIFO_counters_t)); 
+}
+
+
+unsigned int fifo_get_free_space(FIFO_t* fifo)
+{
+    FIFO_stat_t stat; 
+
+    fifo_get_stat(fifo, &stat); 
+    return stat.free; 
+}
+
+
+unsigned int fifo_get_used_space(FIFO_t* fifo)
+{
+    FIFO_stat_t stat; 
+
+    fifo_get_stat(fifo, &stat); 
+    return stat.used; 
 }
@@ -1,56 +1,80 @@
 #include "class.h"
 
 
+/// @brief Append a line to a sys/class list, unless the page could no longer 
+///        hold the end of list marker after it. Then the marker is appended 
+///        instead, so the list never ends in the middle of a line. 
+/// @param buf  sysfs page. 
+/// @param len  bytes already in the page, moved past what was appended. 
+/// @param line line to append, with its newline. 
+/// @return true if the line was appended, false once the list is cut. 
+static bool fifo_emit_line(char* buf, int* len, const char* line)
+{
+    if (*len + strlen(line) + sizeof(FIFO_SYSFS_MORE) > PAGE_SIZE)
+    {
+        *len += sysfs_emit_at(buf, *len, FIFO_SYSFS_MORE); 
+        return false; 
+    }
+
+    *len += sysfs_emit_at(buf, *len, "%s", line); 
+    return true; 
+}
+
+
 ssize_t fifo_buffer_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
-    dev_t   devno; 
-    int     minor; 
-    ssize_t offset; 
-    bool    buf_overflow; 
-    int     i; 
+    FIFO_t*         fifo; 
+    ssize_t         offset; 
+    bool            buf_overflow; 
+    unsigned int    size; 
+    unsigned int    i; 
+
+    // Get the FIFO_t structure attached to the device. 
+    fifo = dev_get_drvdata(dev); 
+
+    // Hold the read mutex so the buffer can't be replaced while we print it. 
+    if (mutex_lock_interruptible(&(fifo->r_mutex)))
+        return -ERESTARTSYS; 
 
-    devno = dev->devt; 
-    minor = MINOR(devno); 
+    size = fifo->size; 
 
     // Check if the buffer is too large to print through sysfs. If it is, 
     // truncate it during printing. 
     buf_overflow = false; 
-    if ((FIFO_BUFFER_SIZE * 2)+ 6 > PAGE_SIZE)
+    if ((size * 2)+ 6 > PAGE_SIZE)
         buf_overflow = true; 
 
     offset = 0; 
 
-    for (i = 0; i < FIFO_BUFFER_SIZE; i += 1)
+    for (i = 0; i < size; i += 1)
     {
-        // Is the buffer is too large, prints only firsts and lasts elements. 
-        if (buf_overflow && i > ELT_CLASS_COUNT + 1 && 
-            i < (FIFO_BUFFER_SIZE - 1) - ELT_CLASS_COUNT + 2)
-            continue; 
-
-        // Print ... for the last element to show in case the buffer is too 
-        // large. 
-        else if (buf_overflow && i == ELT_CLASS_COUNT)
+        // Is the buffer is too large, print ... after the firsts elements 
+        // and jump straight to the lasts ones. 
+        if (buf_overflow && i == ELT_CLASS_COUNT)
         {
             offset += sysfs_emit_at(buf, offset, "|..."); 
+            i = size - ELT_CLASS_COUNT - 1; 
             continue; 
         }
 
         // Print the current element unless it's 0. 
-        else if ((fifos[minor].buffer)[i] > 0x20)
+        else if ((fifo->buffer)[i] > 0x20)
         {
-            offset += sysfs_emit_at(buf, offset, "|%c", (fifos[minor].buffer)[i]); 
+            offset += sysfs_emit_at(buf, offset, "|%c", (fifo->buffer)[i]); 
             continue; 
         }
 
         offset += sysfs_emit_at(buf, offset, "|@"); 
     }
 
+    mutex_unlock(&(fifo->r_mutex)); 
+
     // Close the array. 
     offset += sysfs_emit_at(buf, offset, "|\n"); 
     INFO_DEBUG(
-        "[FIFO] Buffer view requested through /sys/class/fifo%d/. "
+        "[FIFO] Buffer view requested through /sys/class/fifo%u/. "
         "Wrote %zu bytes.\n", 
-        minor, 
+        fifo->minor, 
         offset
     ); 
     return offset;
@@ -59,40 +83,233 @@ ssize_t fifo_buffer_show(struct device *dev, struct device_attribute *attr, char
 
 ssize_t fifo_free_space_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
-    dev_t   devno; 
-    int     minor; 
-    int     free_space; 
+    FIFO_t* fifo; 
 
-    // Get the minor number of the device. 
-    devno = dev->devt; 
-    minor = MINOR(devno); 
+    // Get the FIFO_t structure attached to the device. 
+    fifo = dev_get_drvdata(dev); 
 
     // Calculate the available space and send it to the sysfs. 
-    free_space = fifo_get_free_space(minor); 
+    return sysfs_emit(buf, "%u\n", fifo_get_free_space(fifo)); 
+}
+
+
+ssize_t fifo_used_space_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    FIFO_t* fifo; 
 
-    if (free_space < 0)
-        return sysfs_emit(buf, "An error occurred while opening the device MINOR %d.\n", minor); 
+    // Get the FIFO_t structure attached to the device. 
+    fifo = dev_get_drvdata(dev); 
 
-    return sysfs_emit(buf, "%d\n", free_space); 
+    // Calculate the used space and send it to the sysfs. 
+    return sysfs_emit(buf, "%u\n", fifo_get_used_space(fifo)); 
 }
 
 
-ssize_t fifo_used_space_show(struct device *dev, struct device_attribute *attr, char *buf)
+ssize_t fifo_stat_show(struct device *dev, struct device_attribute *attr, char *buf)
 {
-    dev_t   devno; 
-    int     minor; 
-    int     free_space; 
+    FIFO_stat_t stat; 
+    FIFO_t*     fifo; 
 
-    // Get the minor number of the device. 
-    devno = dev->devt; 
-    minor = MINOR(devno); 
+    // Get the FIFO_t structure attached to the device. 
+    fifo = dev_get_drvdata(dev); 
+
+    // Take every value from the same snapshot so they add up. 
+    fifo_get_stat(fifo, &stat); 
+
+    return sysfs_emit(
+        buf, "%u %u %u %u %u\n", 
+        stat.used, stat.free, stat.capacity, stat.r_pos, stat.w_pos
+    ); 
+}
 
-    // Calculate the available space and send it to the sysfs. 
-    free_space = fifo_get_free_space(minor); 
 
-    if (free_space < 0)
-        return sysfs_emit(buf, "An error occurred while opening the device MINOR %d.\n", minor); 
 
-    // Calculate the used space using the total buffer size and the free space. 
-    return sysfs_emit(buf, "%d\n", FIFO_BUFFER_SIZE - free_space); 
+ssize_t fifo_stats_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    FIFO_counters_t total; 
+    FIFO_t*         fifo; 
+
+    // Get the FIFO_t structure attached to the device. 
+    fifo = dev_get_drvdata(dev); 
+
+    fifo_get_counters(fifo, &total); 
+
+    return sysfs_emit(
+        buf, "%llu %llu %llu %llu %llu %llu %llu %llu\n", 
+        total.r_bytes, total.w_bytes, total.r_ops, total.w_ops, 
+        total.empty, total.full, total.contended, total.blocked_ns
+    ); 
+}
+
+
+ssize_t fifo_dropped_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    FIFO_counters_t total; 
+    FIFO_t*         fifo; 
+
+    // Get the FIFO_t structure attached to the device. 
+    fifo = dev_get_drvdata(dev); 
+
+    fifo_get_counters(fifo, &total); 
+    return sysfs_emit(buf, "%llu %llu\n", total.dropped, total.dropped_msgs); 
 }
+
+
+ssize_t fifo_readers_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    FIFO_file_t*    file; 
+    FIFO_t*         fifo; 
+    char            line[FIFO_SYSFS_LINE]; 
+    unsigned int    w_cur; 
+    unsigned int    r_cur; 
+    int             len; 
+
+    // Get the FIFO_t structure attached to the device. 
+    fifo = dev_get_drvdata(dev); 
+
+    // Outside of broadcast mode, every reader shares the ring cursor. 
+    len = 0; 
+    spin_lock(&(fifo->readers_lock)); 
+    w_cur = READ_ONCE(fifo->ring->w_cur); 
+    list_for_each_entry(file, &(fifo->readers), node)
+    {
+        r_cur = (fifo->mode & FIFO_MODE_BROADCAST) ? file->r_cur : fifo->ring->r_cur; 
+        scnprintf(
+            line, sizeof(line), "%d %u%s\n", 
+            file->pid, ring_used(r_cur, w_cur, READ_ONCE(fifo->size)), file->dropped ? " dropped" : ""
+        ); 
+
+        if (!fifo_emit_line(buf, &len, line))
+            break; 
+    }
+
+    spin_unlock(&(fifo->readers_lock)); 
+    return len; 
+}
+
+
+ssize_t fifo_shards_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    FIFO_shard_t*   shard; 
+    FIFO_t*         fifo; 
+    char            line[FIFO_SYSFS_LINE]; 
+    unsigned int    cpu; 
+    int             len; 
+
+    // Get the FIFO_t structure attached to the device. 
+    fifo = dev_get_drvdata(dev); 
+
+    // Keep a resize or a mode change from freeing the rings under us. 
+    len = 0; 
+    percpu_down_read(&(fifo->shard_sem)); 
+    for (cpu = 0; fifo->shards && cpu < nr_cpu_ids; cpu += 1)
+    {
+        shard = &(fifo->shards[cpu]); 
+        if (!smp_load_acquire(&(shard->buffer)))
+            continue; 
+
+        scnprintf(
+            line, sizeof(line), "%u %u %u\n", 
+            cpu, ring_used(READ_ONCE(shard->ctl.r_cur), READ_ONCE(shard->ctl.w_cur), shard->ctl.size), 
+            shard->ctl.size
+        ); 
+
+        if (!fifo_emit_line(buf, &len, line))
+            break; 
+    }
+
+    percpu_up_read(&(fifo->shard_sem)); 
+    return len; 
+}
+
+
+ssize_t fifo_node_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    FIFO_t* fifo; 
+
+    // Get the FIFO_t structure attached to the device. 
+    fifo = dev_get_drvdata(dev); 
+
+    return sysfs_emit(buf, "%d\n", READ_ONCE(fifo->node)); 
+}
+
+
+ssize_t fifo_cpus_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    FIFO_t* fifo; 
+    int     r_cpu; 
+    int     w_cpu; 
+
+    // Get the FIFO_t structure attached to the device. 
+    fifo = dev_get_drvdata(dev); 
+
+    // A CPU gone offline since keeps its node. 
+    r_cpu = READ_ONCE(fifo->r_cpu); 
+    w_cpu = READ_ONCE(fifo->w_cpu); 
+    return sysfs_emit(
+        buf, "%d %d %d %d\n", 
+        r_cpu, r_cpu < 0 ? -1 : cpu_to_node(r_cpu), w_cpu, w_cpu < 0 ? -1 : cpu_to_node(w_cpu)
+    ); 
+}
+
+
+ssize_t fifo_backing_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    FIFO_t*         fifo; 
+    unsigned int    huge; 
+    unsigned int    size; 
+
+    // Get the FIFO_t structure attached to the device. 
+    fifo = dev_get_drvdata(dev); 
+
+    // Hold the read mutex so the buffer can't be replaced while we look at it. 
+    if (mutex_lock_interruptible(&(fifo->r_mutex)))
+        return -ERESTARTSYS; 
+
+    huge = fifo->huge; 
+    size = fifo->size; 
+    mutex_unlock(&(fifo->r_mutex)); 
+
+    return sysfs_emit(
+        buf, "%s %u %u\n", 
+        huge == size ? "huge" : (huge ? "partial" : "small"), huge, size
+    ); 
+}
+
+
+/// @brief Print the wait latency histogram of a FIFO. 
+/// @param m      sequence file, its private data is the FIFO. 
+/// @param unused not used. 
+/// @return 0. 
+static int fifo_hist_show(struct seq_file* m, void* unused)
+{
+    FIFO_counters_t total; 
+    FIFO_t*         fifo; 
+    int             i; 
+
+    fifo = m->private; 
+    fifo_get_counters(fifo, &total); 
+
+    // Bucket i holds the waits of 2^i to 2^(i+1) microseconds. 
+    seq_printf(m, "%10s %8s %12s\n", "from (us)", "to (us)", "waits"); 
+    for (i = 0; i < FIFO_HIST_BUCKETS; i += 1)
+    {
+        if (i == FIFO_HIST_BUCKETS - 1)
+            seq_printf(m, "%10lu %8s %12llu\n", 1UL << i, "-", total.wait_hist[i]); 
+
+        else 
+            seq_printf(
+                m, "%10lu %8lu %12llu\n", 
+                i ? 1UL << i : 0, 1UL << (i + 1), total.wait_hist[i]
+            ); 
+    }
+
+    seq_printf(m, "total blocked: %llu ns\n", total.blocked_ns); 
+    return 0; 
+}
+
+
+int fifo_hist_open(struct inode* inode, struct file* fp)
+{
+    return single_open(fp, fifo_hist_show, inode->i_private); 
+}
\ No newline at end of file
@@ -1,216 +1,993 @@
 #include "fops.h"
+#include "fifo_trace.h"
 
 
 
-ssize_t fifo_read(struct file* fp, char __user* buf, size_t nbc, loff_t* pos)
+int fifo_open(struct inode* inode, struct file* fp)
 {
-    unsigned int    minor;
-    int             retval; 
-    size_t          to_read; 
-    size_t          been_read; 
-    char*           kbuf; 
+    FIFO_file_t*    file; 
+    FIFO_t*         fifo; 
 
-    // Get the device minor number that asked the read. 
-    #if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 9, 0) 
-        minor = iminor(file_inode(fp)); 
-    #else
-        minor = MINOR(fp->f_path.dentry->d_inode->i_rdev);
-    #endif
-    
-    if (minor > FIFO_DEV_COUNT - 1)
+    // Find the device and keep it alive until the file is released. 
+    fifo = fifo_get(iminor(inode)); 
+    if (!fifo)
     {
         ERR_DEBUG("[FIFO] Trying to access an unregistered device.\n"); 
         return -ENODEV; 
     }
 
-    INFO_DEBUG(
-        "[FIFO] %zu byte(s) read operation asked from MINOR %d, "
-        "read_cursor currently at %d\n", nbc, minor, fifos[minor].r_cur
-    ); 
+    // Each open file gets its own read cursor, used in broadcast mode. 
+    file = kzalloc(sizeof(FIFO_file_t), GFP_KERNEL); 
+    if (!file)
+    {
+        fifo_put(fifo); 
+        return -ENOMEM; 
+    }
 
-    // If the read cursor is already on write cursor, read nothing. 
-    if ((fifos[minor].r_cur + 1) % FIFO_BUFFER_SIZE == fifos[minor].w_cur)
-        return 0; 
+    file->fifo = fifo; 
+    file->pid = task_tgid_nr(current); 
+    INIT_LIST_HEAD(&(file->node)); 
+
+    // Reads and writes honour IOCB_NOWAIT, let asynchronous submitters use it. 
+    fp->private_data = file; 
+    fp->f_mode |= FMODE_NOWAIT; 
+
+    // Count the openers of each side, a second one makes that side use its 
+    // mutex. Readers are listed on the device, to follow them in broadcast 
+    // mode. 
+    if (fp->f_mode & FMODE_READ)
+    {
+        atomic_inc(&(fifo->r_openers)); 
+        fifo_attach(fifo, file); 
+    }
+
+    if (fp->f_mode & FMODE_WRITE)
+        atomic_inc(&(fifo->w_openers)); 
+
+    return 0; 
+}
+
+
+int fifo_release(struct inode* inode, struct file* fp)
+{
+    FIFO_file_t*    file; 
+    FIFO_t*         fifo; 
+
+    file = fp->private_data; 
+    fifo = file->fifo; 
+
+    if (fp->f_mode & FMODE_READ)
+    {
+        fifo_detach(fifo, file); 
+        atomic_dec(&(fifo->r_openers)); 
+    }
+
+    if (fp->f_mode & FMODE_WRITE)
+        atomic_dec(&(fifo->w_openers)); 
+
+    kfree(file); 
+    fifo_put(fifo); 
+    return 0; 
+}
+
+
+/// @brief Take the read side of a FIFO once it holds enough data: up to the 
+///        high watermark, or anything for a read that can't wait. The side is 
+///        released while sleeping so the device can still be reset or resized. 
+/// @param fifo   pointer to the fifo structure. 
+/// @param file   open file reading, for its cursor in broadcast mode. 
+/// @param nowait true to return -EAGAIN instead of sleeping. 
+/// @param want   number of bytes the caller could read at once, the write 
+///               cursor is only loaded when fewer are known to be there. 
+/// @param r_cur  set to the read cursor. 
+/// @param w_cur  set to the write cursor. 
+/// @return the value to give to fifo_read_unlock, FIFO_LOCK_SHARDED with 
+///         the side released once the device is sharded, -EAGAIN, -EPIPE if 
+///         a writer dropped the reader in broadcast mode, or -ERESTARTSYS. 
+static int fifo_read_wait(FIFO_t* fifo, FIFO_file_t* file, bool nowait, unsigned int want, 
+                          unsigned int* r_cur, unsigned int* w_cur)
+{
+    unsigned int    threshold; 
+    unsigned int    used; 
+    int             lock; 
+
+    while (true)
+    {
+        lock = nowait ? fifo_read_trylock(fifo) : fifo_read_lock(fifo); 
+        if (lock < 0)
+            return lock;
+
+        if (READ_ONCE(file->dropped))
+        {
+            fifo_read_unlock(fifo, lock); 
+            return -EPIPE; 
+        }
+
+        // The messages of a sharded device are in the rings of each CPU. 
+        if (fifo->mode & FIFO_MODE_SHARDED)
+        {
+            fifo_read_unlock(fifo, lock); 
+            return FIFO_LOCK_SHARDED; 
+        }
+
+        // Pairs with the release of w_cur by the writers: every byte behind 
+        // the write cursor we load is visible. The read cursor comes first, 
+        // an overwriting writer may move it but never past that write cursor. 
+        // The copy of the write cursor kept by the read side spares us the 
+        // cache line of the writers while it shows what we are after. 
+        threshold = nowait ? 1 : fifo_read_threshold(fifo); 
+        *r_cur = smp_load_acquire(fifo_read_cursor(fifo, file)); 
+        used = ring_read_used(fifo->ring, *r_cur, fifo->size, max(want, threshold)); 
+        *w_cur = fifo->ring->w_cache; 
+        if (used && used >= threshold)
+            return lock; 
+
+        fifo_read_unlock(fifo, lock); 
+        if (!used)
+            FIFO_COUNT(fifo, empty, 1); 
+
+        if (nowait)
+            return -EAGAIN; 
+
+        // The writer wakes us up once the bytes it published reach the high 
+        // watermark, or once the device entered sharded mode. 
+        if (FIFO_WAIT_EVENT(fifo, 
+            fifo->r_wait, 
+            fifo_file_readable(fifo, file) || (READ_ONCE(fifo->mode) & FIFO_MODE_SHARDED)
+        ))
+            return -ERESTARTSYS;
+    }
+}
 
-    // Else, allocate a kernel buffer to read the fifo buffer. 
-    kbuf = (char*)kmalloc(nbc, GFP_KERNEL); 
-    if (!kbuf)
-        return -ENOMEM; 
 
-    // Protect the read operation from other concurrent process by locking the 
-    // read mutex. 
-    if (mutex_lock_interruptible(&(fifos[minor].r_mutex)))
-        return -ERESTARTSYS;
+ssize_t fifo_read_iter(struct kiocb* iocb, struct iov_iter* to)
+{
+    FIFO_file_t*    file; 
+    FIFO_t*         fifo; 
+    bool            nowait; 
+    bool            sharded; 
+    int             lock; 
+    int             retval; 
+    ssize_t         msg_len; 
+    unsigned int    r_cur; 
+    unsigned int    w_cur; 
+    unsigned int    r_pos; 
+    unsigned int    header; 
+    int             len; 
+    size_t          nbc; 
+    size_t          used; 
+    size_t          to_read; 
+    size_t          first_seg; 
+    size_t          been_read; 
 
-    // Read the buffer we reach the number of bytes we want to read or until we 
-    // reach the write cursor. 
-    been_read = 0; 
-    to_read = nbc; 
-    while (to_read > 0)
+    // Get the device that asked the read, attached to the file when opened. 
+    file = iocb->ki_filp->private_data; 
+    fifo = file->fifo; 
+    nbc = iov_iter_count(to); 
+
+    if (!nbc)
+        return 0; 
+
+    // Asynchronous submitters ask for IOCB_NOWAIT: neither sleep for data nor 
+    // for the read side, just like a non-blocking file. 
+    nowait = (iocb->ki_flags & IOCB_NOWAIT) || (iocb->ki_filp->f_flags & O_NONBLOCK); 
+
+    while (true)
     {
-        fifos[minor].r_cur = (fifos[minor].r_cur + 1) % FIFO_BUFFER_SIZE; 
-        kbuf[been_read] = (fifos[minor].buffer)[fifos[minor].r_cur]; 
+        // Protect the read operation from other concurrent readers by taking 
+        // the read side, and wait for data while the FIFO is empty. A sharded 
+        // device is read from the rings of each CPU, until it leaves that 
+        // mode. 
+        lock = FIFO_LOCK_SHARDED; 
+        if (!(READ_ONCE(fifo->mode) & FIFO_MODE_SHARDED))
+            lock = fifo_read_wait(
+                fifo, file, nowait, (READ_ONCE(fifo->mode) & FIFO_MODE_RECORD) ? 1 : min_t(size_t, nbc, UINT_MAX), 
+                &r_cur, &w_cur
+            ); 
+
+        if (lock == FIFO_LOCK_SHARDED)
+        {
+            msg_len = fifo_shard_read(fifo, to, nbc, nowait, &sharded); 
+            if (sharded)
+                return msg_len; 
+
+            continue; 
+        }
+
+        if (lock < 0)
+            return lock; 
+
+        // The cursors count the bytes read and written since the last reset, 
+        // so the readable area is their difference, starting at the masked 
+        // read cursor. Copy it in at most two contiguous segments: from the 
+        // read position up to the end of the buffer, then from the start of 
+        // the buffer. The cursors are in memory processes can map and write, 
+        // so cap the used space to the buffer size to never copy past it. 
+        used = ring_used(r_cur, w_cur, fifo->size); 
+        to_read = min(nbc, used); 
+        header = 0; 
+
+        // In record mode, return exactly the next message, without its 
+        // header. A message too large for the request stays in the FIFO. A 
+        // header overwritten while we read it is no error, just stale. 
+        if (fifo->mode & FIFO_MODE_RECORD)
+        {
+            len = fifo_record_length(fifo, r_cur, used); 
+            if (len >= 0 && len > nbc)
+                len = -EMSGSIZE; 
+
+            if (len < 0 && READ_ONCE(*fifo_read_cursor(fifo, file)) != r_cur)
+            {
+                fifo_read_unlock(fifo, lock); 
+                continue; 
+            }
+
+            if (len < 0)
+            {
+                fifo_read_unlock(fifo, lock); 
+                return len; 
+            }
+
+            header = FIFO_RECORD_HEADER; 
+            to_read = len; 
+        }
+
+        r_pos = (r_cur + header) & fifo->mask; 
+        first_seg = min(to_read, (size_t)(fifo->size - r_pos)); 
+
+        // Copy both segments into the user-space segments of the request, a 
+        // single copy fills as many of them as it needs. On a fault, only the 
+        // bytes actually copied are consumed so no data is lost, and a 
+        // message is only consumed once copied whole. 
+        been_read = copy_to_iter(fifo->buffer + r_pos, first_seg, to); 
+        if (been_read == first_seg)
+            been_read += copy_to_iter(fifo->buffer, to_read - first_seg, to); 
 
-        been_read += 1; 
-        to_read -= 1; 
+        if (!been_read || (header && been_read != to_read))
+        {
+            fifo_read_unlock(fifo, lock); 
+            return -EFAULT; 
+        }
 
-        // If we reach the write cursor, stop the read. 
-        if (((fifos[minor].r_cur + 1) % FIFO_BUFFER_SIZE) == fifos[minor].w_cur)
+        // Move the read cursor once for the whole copy. If an overwriting 
+        // writer dropped those bytes meanwhile, what we copied may be torn: 
+        // take it back and read the new oldest data instead. A broadcast 
+        // reader dropped meanwhile has nothing left to read. 
+        retval = fifo_consume(fifo, file, r_cur, r_cur + header + (unsigned int)been_read); 
+        if (!retval)
             break; 
+
+        iov_iter_revert(to, been_read); 
+        fifo_read_unlock(fifo, lock); 
+        if (retval != -EAGAIN)
+            return retval; 
     }
 
-    if (!w_is_unlock)
+    trace_fifo_dequeue(fifo->minor, been_read, r_cur + header + been_read, w_cur); 
+    FIFO_COUNT(fifo, r_bytes, been_read); 
+    FIFO_COUNT(fifo, r_ops, 1); 
+    FIFO_NOTE_CPU(fifo, r_cpu); 
+
+    // Wake up the pollers and a writer of this device waiting for space, 
+    // once the used space dropped to the low watermark. 
+    fifo_wake_writers(fifo); 
+
+    // Release the read side. 
+    fifo_read_unlock(fifo, lock); 
+    return been_read; 
+}
+
+
+/// @brief Write a whole message to a record mode FIFO, after a header holding 
+///        its length. The write side is only owned once the message fits, so 
+///        a writer waiting for space never blocks the other writers. 
+/// @param fifo   pointer to the fifo structure. 
+/// @param from   user-space segments holding the message. 
+/// @param nbc    length of the message. 
+/// @param nowait true to return -EAGAIN instead of sleeping. 
+/// @return the message length, -EMSGSIZE if it can't fit in the buffer, 
+///         -EAGAIN, -ERESTARTSYS or -EFAULT otherwise. 
+static ssize_t fifo_write_record(FIFO_t* fifo, struct iov_iter* from, size_t nbc, bool nowait)
+{
+    int             lock; 
+    unsigned int    header; 
+    unsigned int    len; 
+    unsigned int    r_cur; 
+    unsigned int    w_cur; 
+    unsigned int    w_pos; 
+    size_t          free_space; 
+    size_t          first_seg; 
+    size_t          copied; 
+
+    if (!nbc)
+        return 0; 
+
+    while (true)
     {
-        w_is_unlock = true; 
-        wake_up_interruptible(&w_wait_queue); 
+        lock = nowait ? fifo_write_trylock(fifo) : fifo_write_lock(fifo); 
+        if (lock < 0)
+            return lock; 
+
+        // If the device left record mode while we were sleeping, the message 
+        // is written as plain bytes, still whole. 
+        header = (fifo->mode & FIFO_MODE_RECORD) ? FIFO_RECORD_HEADER : 0; 
+        if (nbc > fifo->size - header)
+        {
+            fifo_write_unlock(fifo, lock); 
+            fifo_wake_writers(fifo); 
+            return -EMSGSIZE; 
+        }
+
+        // The copy of the read cursor kept by the write side spares us the 
+        // cache line of the readers while the message fits. 
+        w_cur = READ_ONCE(fifo->ring->w_cur); 
+        free_space = fifo->size - ring_write_used(fifo->ring, w_cur, fifo->size, nbc + header); 
+        r_cur = fifo->ring->r_cache; 
+        if (free_space >= nbc + header)
+            break; 
+
+        // In broadcast mode, the readers too far behind make room by leaving. 
+        if (fifo_drop_readers(fifo))
+        {
+            fifo_write_unlock(fifo, lock); 
+            continue; 
+        }
+
+        // In overwrite mode, drop the oldest messages rather than wait. 
+        if (fifo->mode & FIFO_MODE_OVERWRITE)
+        {
+            fifo_overwrite(fifo, w_cur, nbc + header); 
+            break; 
+        }
+
+        fifo_write_unlock(fifo, lock); 
+        FIFO_COUNT(fifo, full, 1); 
+
+        if (nowait)
+            return -EAGAIN; 
+
+        // Also wake up if a resize made the message too large to ever fit. 
+        // Each writer waits for room for its own message, so the wait is not 
+        // exclusive: a wake up taken by a writer that still doesn't fit would 
+        // be lost for a smaller one. 
+        trace_fifo_writer_block(fifo->minor, nbc + header, r_cur, w_cur); 
+        if (FIFO_WAIT_EVENT(fifo, 
+            fifo->w_wait, 
+            fifo_get_free_space(fifo) >= nbc + header || 
+            nbc + header > READ_ONCE(fifo->size)
+        ))
+            return -ERESTARTSYS;
+
+        trace_fifo_writer_wake(fifo->minor, fifo_get_free_space(fifo), r_cur, w_cur); 
     }
 
-    // Copy the kernel buffer into user-space buffer, free the kernel buffer 
-    // and return the number of bytes returned. 
-    retval = copy_to_user(buf, kbuf, been_read);
-    kfree(kbuf); 
+    // Copy the message after the room left for its header. Nothing is 
+    // published on a fault, so a reader never sees a partial message. 
+    len = nbc; 
+    w_pos = (w_cur + header) & fifo->mask; 
+    first_seg = min((size_t)len, (size_t)(fifo->size - w_pos)); 
 
-    if (retval) 
+    copied = copy_from_iter(fifo->buffer + w_pos, first_seg, from); 
+    if (copied == first_seg)
+        copied += copy_from_iter(fifo->buffer, len - first_seg, from); 
+
+    if (copied != len)
+    {
+        fifo_write_unlock(fifo, lock); 
+        fifo_wake_writers(fifo); 
         return -EFAULT; 
-    
-    // Unlock the read mutex. 
-    mutex_unlock(&(fifos[minor].r_mutex));
-    
-    INFO_DEBUG(
-        "[FIFO] %zu byte(s) returned to MINOR %d, read_cursor "
-        "currently at %d.\n", been_read, minor, fifos[minor].r_cur
-    );
+    }
 
-    return been_read; 
+    // Publish the header and the message together. 
+    fifo_poke(fifo, w_cur, &len, header); 
+    smp_store_release(&(fifo->ring->w_cur), w_cur + header + len); 
+    trace_fifo_enqueue(fifo->minor, len, r_cur, w_cur + header + len); 
+    FIFO_COUNT(fifo, w_bytes, len); 
+    FIFO_COUNT(fifo, w_ops, 1); 
+    FIFO_NOTE_CPU(fifo, w_cpu); 
+    fifo_wake_readers(fifo); 
+
+    // Pass the wake up on to the next writer while there is room left. 
+    fifo_write_unlock(fifo, lock); 
+    fifo_wake_writers(fifo); 
+    return len; 
 }
 
 
-ssize_t fifo_write(struct file* fp, const char __user* buf, size_t nbc, loff_t* pos)
+ssize_t fifo_write_iter(struct kiocb* iocb, struct iov_iter* from)
 {
-    int             retval;
-    unsigned int    minor;
-    char*           kbuf;
-    size_t          i; 
+    FIFO_t*         fifo; 
+    bool            nowait; 
+    bool            sharded; 
+    int             lock; 
+    unsigned int    r_cur; 
+    unsigned int    w_cur; 
+    unsigned int    w_pos; 
+    size_t          nbc; 
+    size_t          free_space; 
+    size_t          to_write; 
+    size_t          first_seg; 
+    size_t          copied; 
+    size_t          written; 
+    ssize_t         error; 
 
-    // Get the device minor number that asked the write. 
-    #if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 9, 0) 
-        minor = iminor(file_inode(fp)); 
-    #else
-        minor = MINOR(fp->f_path.dentry->d_inode->i_rdev);
-    #endif
+    // Get the device that asked the write, attached to the file when opened. 
+    fifo = ((FIFO_file_t*)iocb->ki_filp->private_data)->fifo; 
+    nbc = iov_iter_count(from); 
 
-    if (minor > FIFO_DEV_COUNT - 1)
+    // Asynchronous submitters ask for IOCB_NOWAIT: neither sleep for space nor 
+    // for the write side, just like a non-blocking file. 
+    nowait = (iocb->ki_flags & IOCB_NOWAIT) || (iocb->ki_filp->f_flags & O_NONBLOCK); 
+
+    // A sharded device takes each message in the ring of the CPU we run on, 
+    // without the write side. Writers still on the main ring when it entered 
+    // that mode are read first. 
+    if (READ_ONCE(fifo->mode) & FIFO_MODE_SHARDED)
     {
-        ERR_DEBUG("[FIFO] Trying to access an unregistered device.\n"); 
-        return -ENODEV; 
+        error = fifo_shard_write(fifo, from, nbc, nowait, &sharded); 
+        if (sharded)
+            return error; 
     }
 
-    INFO_DEBUG(
-        "[FIFO] %zu byte(s) write operation asked from MINOR %d, "
-        "write_cursor currently at %d\n", nbc, minor, fifos[minor].w_cur
-    ); 
+    if (READ_ONCE(fifo->mode) & FIFO_MODE_RECORD)
+        return fifo_write_record(fifo, from, nbc, nowait); 
 
-    // If the next write cursor is the read cursor, abort the read to not 
-    // overwrite the read buffer. 
-    if (fifos[minor].w_cur == fifos[minor].r_cur)
+    // Protect the write operation from other concurrent writers by taking the 
+    // write side. Every segment of the request is written under this single 
+    // hold unless it has to wait for space, so vectored writes that fit are 
+    // never interleaved with other writers. 
+    lock = nowait ? fifo_write_trylock(fifo) : fifo_write_lock(fifo); 
+    if (lock < 0)
+        return lock;
+
+    // The device may have entered record mode while we waited for the side. 
+    if (fifo->mode & FIFO_MODE_RECORD)
     {
-        INFO_DEBUG("[FIFO] No space left to write, waiting for read.\n"); 
-        w_is_unlock = false; 
-        wait_event_interruptible(w_wait_queue, w_is_unlock);
+        fifo_write_unlock(fifo, lock); 
+        return fifo_write_record(fifo, from, nbc, nowait); 
     }
 
-    // Allocate a kernel buffer and get user-space provided data. 
-    kbuf = (char*)kmalloc(nbc, GFP_KERNEL);
-    if (!kbuf)
-        return -ENOMEM; 
+    error = 0; 
+    written = 0; 
+    while (written < nbc)
+    {
+        // Every byte the reader has not consumed yet is in use, the rest of 
+        // the buffer is free. Pairs with the release of r_cur in 
+        // fifo_read_iter: the reader is done with every byte up to the cursor 
+        // we load, only loaded once our copy of it is short of the rest of 
+        // the request. 
+        w_cur = READ_ONCE(fifo->ring->w_cur); 
+        free_space = fifo->size - ring_write_used(
+            fifo->ring, w_cur, fifo->size, min_t(size_t, nbc - written, fifo->size)
+        ); 
+        r_cur = fifo->ring->r_cache; 
+
+        // In overwrite mode, a full FIFO drops its oldest bytes, as many as 
+        // the rest of the request needs. 
+        if (!free_space && (fifo->mode & FIFO_MODE_OVERWRITE))
+        {
+            fifo_overwrite(fifo, w_cur, min(nbc - written, (size_t)fifo->size)); 
+            continue; 
+        }
+
+        // In broadcast mode, the readers too far behind make room by leaving. 
+        if (!free_space && fifo_drop_readers(fifo))
+            continue; 
+
+        // If the write cursor is a whole buffer ahead of the read cursor, no 
+        // space left to write, block the execution until a read frees some. 
+        // In non-blocking mode, report the bytes accepted so far instead. 
+        if (!free_space)
+        {
+            FIFO_COUNT(fifo, full, 1); 
+            if (nowait)
+            {
+                error = -EAGAIN; 
+                break; 
+            }
+
+            // The readers we would wait for may be sleeping on the bytes we 
+            // already published. 
+            fifo_wake_readers(fifo); 
+
+            // Release the write side while sleeping so a reset, a resize or a 
+            // mode change never waits for a reader. Other writers may then 
+            // come in between what we wrote and the rest of the request. 
+            fifo_write_unlock(fifo, lock); 
+
+            // Sleep until the readers brought the used space down to the low 
+            // watermark, rather than waking up for every byte they free. 
+            trace_fifo_writer_block(fifo->minor, nbc - written, r_cur, w_cur); 
+            if (FIFO_WAIT_EVENT_EXCLUSIVE(fifo, fifo->w_wait, fifo_writable(fifo)))
+                lock = -ERESTARTSYS; 
+
+            else 
+                lock = fifo_write_lock(fifo); 
 
-    retval = copy_from_user(kbuf, buf, nbc); 
-    if (retval)
+            if (lock < 0)
+            {
+                error = lock; 
+                break; 
+            }
+
+            trace_fifo_writer_wake(fifo->minor, fifo_get_free_space(fifo), r_cur, w_cur); 
+
+            // Once our bytes were consumed, the device may have been switched 
+            // to record mode, where they can't be followed by raw bytes. 
+            if (fifo->mode & FIFO_MODE_RECORD)
+            {
+                if (written)
+                    break; 
+
+                fifo_write_unlock(fifo, lock); 
+                return fifo_write_record(fifo, from, nbc, nowait); 
+            }
+
+            continue; 
+        }
+
+        // Copy as much as fits in at most two contiguous segments, split at the 
+        // end of the buffer, and move the write cursor once for the whole copy. 
+        to_write = min(nbc - written, free_space); 
+        w_pos = w_cur & fifo->mask; 
+        first_seg = min(to_write, (size_t)(fifo->size - w_pos)); 
+
+        // Copy both segments from the user-space segments of the request. On 
+        // a fault, publish what was copied and stop the write. 
+        copied = copy_from_iter(fifo->buffer + w_pos, first_seg, from); 
+        if (copied == first_seg)
+            copied += copy_from_iter(fifo->buffer, to_write - first_seg, from); 
+
+        // Publish the new bytes to the reader. 
+        smp_store_release(&(fifo->ring->w_cur), w_cur + (unsigned int)copied); 
+        trace_fifo_enqueue(fifo->minor, copied, r_cur, w_cur + copied); 
+        written += copied; 
+
+        if (copied != to_write)
+        {
+            error = -EFAULT; 
+            break; 
+        }
+    }
+
+    // Wake up the readers and pollers of this device waiting for data, once 
+    // for the whole request. 
+    if (written)
     {
-        kfree(kbuf); 
-        return -EFAULT; 
+        FIFO_COUNT(fifo, w_bytes, written); 
+        FIFO_COUNT(fifo, w_ops, 1); 
+        FIFO_NOTE_CPU(fifo, w_cpu); 
+        fifo_wake_readers(fifo); 
     }
 
-    // Protect the write operation from other concurrent process by locking the 
-    // write mutex. 
-    if (mutex_lock_interruptible(&(fifos[minor].w_mutex)))
-        return -ERESTARTSYS;
+    // Release the write side, unless a signal interrupted us while we didn't 
+    // own it, and pass the wake up on to the next writer while there is room 
+    // left. 
+    if (lock >= 0)
+        fifo_write_unlock(fifo, lock); 
+
+    fifo_wake_writers(fifo); 
+
+    // A fault, a signal or a full FIFO in non-blocking mode stopped the write 
+    // before anything was copied. 
+    if (!written && nbc)
+        return error; 
+
+    return written; 
+}
+
+
+__poll_t fifo_poll(struct file* fp, poll_table* wait)
+{
+    FIFO_stat_t     stat; 
+    FIFO_file_t*    file; 
+    FIFO_t*         fifo; 
+    unsigned int    used; 
+    __poll_t        mask; 
+
+    file = fp->private_data; 
+    fifo = file->fifo; 
+
+    // Register on both wait queues of the device, then report its state. A 
+    // change after the snapshot wakes us up through the queues. 
+    poll_wait(fp, &(fifo->r_wait), wait); 
+    poll_wait(fp, &(fifo->w_wait), wait); 
+
+    // Pairs with the barrier in wq_has_sleeper(), so either the waker sees us 
+    // on the queue or we see its cursor moved. 
+    smp_mb(); 
+
+    if (READ_ONCE(fifo->mode) & FIFO_MODE_SHARDED)
+        return fifo_shard_poll(fifo); 
+
+    fifo_get_stat(fifo, &stat); 
+
+    // Report the device like the sleepers see it: readable from the high 
+    // watermark, writable down from the low watermark. A broadcast reader 
+    // counts from its own cursor, and reports an error once dropped. 
+    mask = 0; 
+    used = stat.used; 
+    if (fifo_read_cursor(fifo, file) != &(fifo->ring->r_cur))
+        used = fifo_file_used(fifo, file); 
+
+    if (used && used >= fifo_read_threshold(fifo))
+        mask |= EPOLLIN | EPOLLRDNORM; 
+
+    if (READ_ONCE(file->dropped))
+        mask |= EPOLLERR; 
+
+    // In record mode, a message needs room for its header as well. In 
+    // overwrite mode, writes never wait. 
+    if (stat.used <= READ_ONCE(fifo->lowat) && 
+        stat.free > ((READ_ONCE(fifo->mode) & FIFO_MODE_RECORD) ? FIFO_RECORD_HEADER : 0))
+        mask |= EPOLLOUT | EPOLLWRNORM; 
+
+    if (READ_ONCE(fifo->mode) & FIFO_MODE_OVERWRITE)
+        mask |= EPOLLOUT | EPOLLWRNORM; 
+
+    // A full broadcast device makes room by dropping the readers too far 
+    // behind, which the next write does. Polling never drops them itself. 
+    if ((fp->f_mode & FMODE_WRITE) && !(mask & EPOLLOUT) && fifo_readers_lagging(fifo))
+        mask |= EPOLLOUT | EPOLLWRNORM; 
+
+    return mask; 
+}
+
+
+int fifo_mmap(struct file* fp, struct vm_area_struct* vma)
+{
+    FIFO_file_t*    file; 
+
+    file = fp->private_data; 
+    return fifo_mmap_ring(file->fifo, vma); 
+}
+
+
+/// @brief Write the messages of a batch under a single ownership of the write 
+///        side and publish them at once, in record mode each one after its 
+///        header. Sleeps until the first message fits, unless the file is 
+///        non-blocking, then stops at the first one that doesn't. 
+/// @param fp  pointer to the file structure. 
+/// @param arg user-space batch description. 
+/// @return the number of messages written, negative if none could be. 
+static long int fifo_write_batch(struct file* fp, FIFO_batch_t __user* arg)
+{
+    FIFO_file_t*        file; 
+    FIFO_t*             fifo; 
+    FIFO_batch_t        batch; 
+    FIFO_msg_t          msg; 
+    FIFO_msg_t __user*  msgs; 
+    bool                nowait; 
+    int                 lock; 
+    long int            error; 
+    unsigned int        header; 
+    unsigned int        r_cur; 
+    unsigned int        w_cur; 
+    unsigned int        w_next; 
+    unsigned int        free_space; 
+    unsigned int        count; 
+    unsigned int        done; 
+    size_t              bytes; 
+
+    file = fp->private_data; 
+    fifo = file->fifo; 
+    nowait = fp->f_flags & O_NONBLOCK; 
+
+    // A batch is published at once behind a single write cursor, the rings 
+    // of a sharded device each have their own. 
+    if (READ_ONCE(fifo->mode) & FIFO_MODE_SHARDED)
+        return -EOPNOTSUPP; 
+
+    if (copy_from_user(&batch, arg, sizeof(FIFO_batch_t)))
+        return -EFAULT; 
+
+    msgs = u64_to_user_ptr(batch.msgs); 
+    count = min(batch.count, (unsigned int)FIFO_BATCH_MAX); 
+    if (!count)
+        return 0; 
+
+    if (copy_from_user(&msg, msgs, sizeof(FIFO_msg_t)))
+        return -EFAULT; 
+
+    // Wait for the first message to fit without owning the write side, like 
+    // a record mode write. 
+    while (true)
+    {
+        lock = nowait ? fifo_write_trylock(fifo) : fifo_write_lock(fifo); 
+        if (lock < 0)
+            return lock; 
+
+        header = (fifo->mode & FIFO_MODE_RECORD) ? FIFO_RECORD_HEADER : 0; 
+        if (msg.len > fifo->size - header)
+        {
+            fifo_write_unlock(fifo, lock); 
+            fifo_wake_writers(fifo); 
+            return -EMSGSIZE; 
+        }
 
-    i = 0; 
-    while (i < nbc)
+        // Like a record mode write, through the copy of the read cursor. 
+        w_cur = READ_ONCE(fifo->ring->w_cur); 
+        free_space = fifo->size - ring_write_used(fifo->ring, w_cur, fifo->size, msg.len + header); 
+        r_cur = fifo->ring->r_cache; 
+        if (free_space >= msg.len + header)
+            break; 
+
+        if (fifo_drop_readers(fifo))
+        {
+            fifo_write_unlock(fifo, lock); 
+            continue; 
+        }
+
+        if (fifo->mode & FIFO_MODE_OVERWRITE)
+        {
+            fifo_overwrite(fifo, w_cur, (size_t)msg.len + header); 
+            free_space = msg.len + header; 
+            break; 
+        }
+
+        fifo_write_unlock(fifo, lock); 
+        FIFO_COUNT(fifo, full, 1); 
+
+        if (nowait)
+            return -EAGAIN; 
+
+        // Not exclusive either, the first message of each batch has its own 
+        // size. 
+        trace_fifo_writer_block(fifo->minor, msg.len + header, r_cur, w_cur); 
+        if (FIFO_WAIT_EVENT(fifo, 
+            fifo->w_wait, 
+            fifo_get_free_space(fifo) >= msg.len + header || 
+            msg.len + header > READ_ONCE(fifo->size)
+        ))
+            return -ERESTARTSYS;
+
+        trace_fifo_writer_wake(fifo->minor, fifo_get_free_space(fifo), r_cur, w_cur); 
+    }
+
+    // Copy every message that fits behind the write cursor, each one whole. 
+    error = 0; 
+    bytes = 0; 
+    w_next = w_cur; 
+    for (done = 0; done < count; done += 1)
     {
-        // Check if the read cursor has moved from it's initialization. If not, 
-        // stop the writting before it to not block the read cursor and lose the
-        // initial write data. 
-        if (fifos[minor].r_cur == -1 && fifos[minor].w_cur == FIFO_BUFFER_SIZE - 1)
+        if (done && copy_from_user(&msg, msgs + done, sizeof(FIFO_msg_t)))
+        {
+            error = -EFAULT; 
+            break; 
+        }
+
+        // Checked like the first message, before any cursor arithmetic can 
+        // wrap around on its length. 
+        if (msg.len > fifo->size - header)
         {
-            INFO_DEBUG("[FIFO] No space left to write, waiting for read.\n"); 
-            w_is_unlock = false; 
-            wait_event_interruptible(w_wait_queue, w_is_unlock); 
+            error = -EMSGSIZE; 
+            break; 
         }
 
-        fifos[minor].buffer[fifos[minor].w_cur] = kbuf[i]; 
+        // Our copy of the read cursor may be behind, load it once the batch 
+        // outgrows it. 
+        if (free_space < header || msg.len > free_space - header)
+            free_space = fifo->size - (w_next - w_cur) - ring_write_used(
+                fifo->ring, w_cur, fifo->size, w_next - w_cur + header + msg.len
+            ); 
+
+        // In overwrite mode, older data makes room for the message, but the 
+        // messages of this batch are never dropped. 
+        if ((free_space < header || msg.len > free_space - header) && 
+            (!(fifo->mode & FIFO_MODE_OVERWRITE) || 
+             fifo_overwrite(fifo, w_cur, (size_t)(w_next - w_cur) + header + msg.len)))
+            break; 
+
+        free_space = max(free_space, header + msg.len); 
 
-        // If the next position is safe, increment the write cursor. 
-        fifos[minor].w_cur = (fifos[minor].w_cur + 1) % FIFO_BUFFER_SIZE;
-        i += 1; 
+        // An empty message has nothing to store, and an empty record would 
+        // read as a corrupted header. 
+        if (!msg.len)
+            continue; 
 
-        // If the write cursor is positionned on the read cursor, no space left 
-        // to write, block the execution. 
-        if (fifos[minor].w_cur == fifos[minor].r_cur)
+        if (fifo_copy_from_user(fifo, w_next + header, u64_to_user_ptr(msg.buf), msg.len))
         {
-            INFO_DEBUG("[FIFO] No space left to write, waiting for read.\n"); 
-            w_is_unlock = false; 
-            wait_event_interruptible(w_wait_queue, w_is_unlock); 
+            error = -EFAULT; 
+            break; 
         }
+
+        fifo_poke(fifo, w_next, &(msg.len), header); 
+        w_next += header + msg.len; 
+        free_space -= header + msg.len; 
+        bytes += msg.len; 
+    }
+
+    // Publish the whole batch to the reader, with a single wake up. 
+    if (w_next != w_cur)
+    {
+        smp_store_release(&(fifo->ring->w_cur), w_next); 
+        trace_fifo_enqueue(fifo->minor, bytes, r_cur, w_next); 
+        FIFO_COUNT(fifo, w_bytes, bytes); 
+        FIFO_COUNT(fifo, w_ops, done); 
+        FIFO_NOTE_CPU(fifo, w_cpu); 
+        fifo_wake_readers(fifo); 
     }
 
-    INFO_DEBUG(
-        "[FIFO] %zu byte(s) written to device with MINOR %d, "
-        "write_cursor currently at %d.\n", nbc, minor, fifos[minor].w_cur
-    ); 
+    fifo_write_unlock(fifo, lock); 
+    fifo_wake_writers(fifo); 
 
-    kfree(kbuf); 
+    if (!done && error)
+        return error; 
 
-    // Unlock the write mutex. 
-    mutex_unlock(&(fifos[minor].w_mutex)); 
-    return nbc; 
+    return done; 
 }
 
 
-long int fifo_ioctl(struct file *fp, unsigned int cmd, unsigned long arg)
+/// @brief Read messages into the buffers of a batch under a single ownership 
+///        of the read side, and consume them at once. In record mode each 
+///        buffer gets one whole message, in stream mode as many bytes as it 
+///        holds. Sleeps while the FIFO is empty, unless the file is 
+///        non-blocking. 
+/// @param fp  pointer to the file structure. 
+/// @param arg user-space batch description, the length of each message read 
+///            is written back in its entry. 
+/// @return the number of messages read, negative if none could be. 
+static long int fifo_read_batch(struct file* fp, FIFO_batch_t __user* arg)
 {
-    int             r_cur; 
-    int             w_cur; 
-    int             retval; 
-    unsigned int    minor; 
+    FIFO_file_t*        file; 
+    FIFO_t*             fifo; 
+    FIFO_batch_t        batch; 
+    FIFO_msg_t          msg; 
+    FIFO_msg_t __user*  msgs; 
+    bool                nowait; 
+    int                 lock; 
+    int                 len; 
+    int                 retval; 
+    long int            error; 
+    unsigned int        header; 
+    unsigned int        r_cur; 
+    unsigned int        r_next; 
+    unsigned int        w_cur; 
+    unsigned int        used; 
+    unsigned int        count; 
+    unsigned int        done; 
+    size_t              bytes; 
+
+    file = fp->private_data; 
+    fifo = file->fifo; 
+    nowait = fp->f_flags & O_NONBLOCK; 
+
+    // A batch is consumed at once behind a single read cursor, the rings of 
+    // a sharded device each have their own. 
+    if (READ_ONCE(fifo->mode) & FIFO_MODE_SHARDED)
+        return -EOPNOTSUPP; 
+
+    if (copy_from_user(&batch, arg, sizeof(FIFO_batch_t)))
+        return -EFAULT; 
 
-    // Get the device minor number that need to be configured. 
-    #if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 9, 0) 
-        minor = iminor(file_inode(fp)); 
-    #else
-        minor = MINOR(fp->f_path.dentry->d_inode->i_rdev);
-    #endif
+    msgs = u64_to_user_ptr(batch.msgs); 
+    count = min(batch.count, (unsigned int)FIFO_BATCH_MAX); 
+    if (!count)
+        return 0; 
 
-    if (minor > FIFO_DEV_COUNT - 1)
+    while (true)
     {
-        ERR_DEBUG("[FIFO] Trying to access an unregistered device.\n"); 
-        return -ENODEV; 
+        // Wait for data without owning the read side, like a read. 
+        lock = fifo_read_wait(fifo, file, nowait, UINT_MAX, &r_cur, &w_cur); 
+        if (lock == FIFO_LOCK_SHARDED)
+            return -EOPNOTSUPP; 
+
+        if (lock < 0)
+            return lock; 
+
+        header = (fifo->mode & FIFO_MODE_RECORD) ? FIFO_RECORD_HEADER : 0; 
+        used = ring_used(r_cur, w_cur, fifo->size); 
+
+        // Fill the buffers in order until the FIFO is empty. A message is 
+        // only consumed once copied and its length given back. 
+        error = 0; 
+        bytes = 0; 
+        r_next = r_cur; 
+        for (done = 0; done < count && used; done += 1)
+        {
+            if (copy_from_user(&msg, msgs + done, sizeof(FIFO_msg_t)))
+            {
+                error = -EFAULT; 
+                break; 
+            }
+
+            if (header)
+            {
+                len = fifo_record_length(fifo, r_next, used); 
+                if (len >= 0 && len > msg.len)
+                    len = -EMSGSIZE; 
+
+                if (len < 0)
+                {
+                    error = len; 
+                    break; 
+                }
+            }
+
+            else 
+                len = min(used, msg.len); 
+
+            if (fifo_copy_to_user(fifo, r_next + header, u64_to_user_ptr(msg.buf), len) || 
+                copy_to_user(&(msgs[done].len), &len, sizeof(unsigned int)))
+            {
+                error = -EFAULT; 
+                break; 
+            }
+
+            r_next += header + len; 
+            used -= header + len; 
+            bytes += len; 
+        }
+
+        // Give the space of the whole batch back to the writers at once. If 
+        // an overwriting writer dropped the data meanwhile, the buffers may 
+        // hold torn messages and a header may have looked corrupted: fill 
+        // them again from the new oldest data. A broadcast reader dropped 
+        // meanwhile has nothing left to read. 
+        retval = 0; 
+        if (r_next != r_cur)
+            retval = fifo_consume(fifo, file, r_cur, r_next); 
+
+        else if (READ_ONCE(*fifo_read_cursor(fifo, file)) != r_cur)
+            retval = -EAGAIN; 
+
+        if (!retval)
+            break; 
+
+        fifo_read_unlock(fifo, lock); 
+        if (retval != -EAGAIN)
+            return retval; 
+    }
+
+    if (r_next != r_cur)
+    {
+        trace_fifo_dequeue(fifo->minor, bytes, r_next, w_cur); 
+        FIFO_COUNT(fifo, r_bytes, bytes); 
+        FIFO_COUNT(fifo, r_ops, done); 
+        FIFO_NOTE_CPU(fifo, r_cpu); 
+        fifo_wake_writers(fifo); 
     }
 
+    fifo_read_unlock(fifo, lock); 
+
+    if (!done && error)
+        return error; 
+
+    return done; 
+}
+
+
+long int fifo_ioctl(struct file *fp, unsigned int cmd, unsigned long arg)
+{
+    int                 r_cur; 
+    int                 w_cur; 
+    int                 retval; 
+    int                 mode; 
+    int                 node; 
+    unsigned int        size; 
+    unsigned int        max_lag; 
+    FIFO_watermarks_t   marks; 
+    FIFO_file_t*        file; 
+    FIFO_t*             fifo; 
+
+    // Get the device that need to be configured, attached to the file when 
+    // opened. 
+    file = fp->private_data; 
+    fifo = file->fifo; 
+
     switch(cmd)
     {
         case IO_FIFO_RESET: 
             // Reset the fifo read and write cursor and clear the buffer. 
-            retval = fifo_reset(minor); 
+            retval = fifo_reset(fifo); 
 
             if (retval)
                 return -EFAULT; 
         break; 
 
         case IO_FIFO_GET_R_CUR: 
-            // Send the read cursor to the userspace. 
-            r_cur = fifos[minor].r_cur; 
+            // Send the read cursor position in the buffer to the userspace. 
+            r_cur = READ_ONCE(*fifo_read_cursor(fifo, file)) & READ_ONCE(fifo->mask); 
             retval = copy_to_user((int __user *)arg, &r_cur, sizeof(int));
 
             if (retval)
@@ -218,14 +995,205 @@ long int fifo_ioctl(struct file *fp, unsigned int cmd, unsigned long arg)
         break; 
 
         case IO_FIFO_GET_W_CUR: 
-            // Send the write cursor to the userspace. 
-            w_cur = fifos[minor].w_cur; 
+            // Send the write cursor position in the buffer to the userspace. 
+            w_cur = READ_ONCE(fifo->ring->w_cur) & READ_ONCE(fifo->mask); 
             retval = copy_to_user((int __user *)arg, &w_cur, sizeof(int)); 
 
             if (retval)
                 return -EFAULT;
         break; 
 
+        case IO_FIFO_SET_SIZE: 
+            // Replace the buffer of an idle device and send back the size 
+            // actually used, rounded up to a power of two. 
+            retval = copy_from_user(&size, (unsigned int __user *)arg, sizeof(unsigned int)); 
+
+            if (retval)
+                return -EFAULT; 
+
+            retval = fifo_resize(fifo, size); 
+
+            if (retval < 0)
+                return retval; 
+
+            size = retval; 
+            retval = copy_to_user((unsigned int __user *)arg, &size, sizeof(unsigned int)); 
+
+            if (retval)
+                return -EFAULT; 
+        break; 
+
+        case IO_FIFO_GET_SIZE: 
+            // Send the buffer size to the userspace. 
+            size = READ_ONCE(fifo->size); 
+            retval = copy_to_user((unsigned int __user *)arg, &size, sizeof(unsigned int)); 
+
+            if (retval)
+                return -EFAULT;
+        break; 
+
+        case IO_FIFO_SET_MODE: 
+            // Set the FIFO_MODE_* flags (record, overwrite, broadcast, 
+            // sharded, ordered) of an empty device, an invalid combination 
+            // is refused. Overwrite, broadcast and sharded mode also need 
+            // the ring not to be mapped. 
+            retval = copy_from_user(&mode, (int __user *)arg, sizeof(int)); 
+
+            if (retval)
+                return -EFAULT; 
+
+            return fifo_set_mode(fifo, mode); 
+
+        case IO_FIFO_GET_MODE: 
+            // Send the mode flags to the userspace. 
+            mode = READ_ONCE(fifo->mode); 
+            retval = copy_to_user((int __user *)arg, &mode, sizeof(int)); 
+
+            if (retval)
+                return -EFAULT; 
+        break; 
+
+        case IO_FIFO_NEXT_SIZE: 
+            // Send the size of the next read, the next message length in 
+            // record mode, so the reader can size its buffer exactly. 
+            retval = fifo_next_size(fifo, file); 
+
+            if (retval < 0)
+                return retval; 
+
+            size = retval; 
+            retval = copy_to_user((unsigned int __user *)arg, &size, sizeof(unsigned int)); 
+
+            if (retval)
+                return -EFAULT; 
+        break; 
+
+        case IO_FIFO_WRITE_BATCH: 
+            // Write many messages with a single system call. 
+            return fifo_write_batch(fp, (FIFO_batch_t __user *)arg); 
+
+        case IO_FIFO_READ_BATCH: 
+            // Read many messages with a single system call. 
+            return fifo_read_batch(fp, (FIFO_batch_t __user *)arg); 
+
+        case IO_FIFO_SET_WATERMARKS: 
+            // Change the used space thresholds waking up writers and readers. 
+            retval = copy_from_user(&marks, (FIFO_watermarks_t __user *)arg, sizeof(FIFO_watermarks_t)); 
+
+            if (retval)
+                return -EFAULT; 
+
+            return fifo_set_watermarks(fifo, marks.low, marks.high); 
+
+        case IO_FIFO_GET_WATERMARKS: 
+            // Send the watermarks to the userspace. 
+            marks.low = READ_ONCE(fifo->lowat); 
+            marks.high = READ_ONCE(fifo->hiwat); 
+            retval = copy_to_user((FIFO_watermarks_t __user *)arg, &marks, sizeof(FIFO_watermarks_t)); 
+
+            if (retval)
+                return -EFAULT; 
+        break; 
+
+        case IO_FIFO_SET_MAX_LAG: 
+            // Change how far behind a broadcast reader can be before a 
+            // writer short of space drops it. 
+            retval = copy_from_user(&max_lag, (unsigned int __user *)arg, sizeof(unsigned int)); 
+
+            if (retval)
+                return -EFAULT; 
+
+            fifo_set_max_lag(fifo, max_lag); 
+        break; 
+
+        case IO_FIFO_GET_MAX_LAG: 
+            // Send the lag limit of the broadcast readers to the userspace. 
+            max_lag = READ_ONCE(fifo->max_lag); 
+            retval = copy_to_user((unsigned int __user *)arg, &max_lag, sizeof(unsigned int)); 
+
+            if (retval)
+                return -EFAULT; 
+        break; 
+
+        case IO_FIFO_SET_NODE: 
+            // Move the buffer to the NUMA node of the CPUs using it, or let 
+            // the allocator choose with -1. 
+            retval = copy_from_user(&node, (int __user *)arg, sizeof(int)); 
+
+            if (retval)
+                return -EFAULT; 
+
+            return fifo_set_node(fifo, node); 
+
+        case IO_FIFO_GET_NODE: 
+            // Send the NUMA node of the buffer to the userspace, -1 for any. 
+            node = READ_ONCE(fifo->node); 
+            retval = copy_to_user((int __user *)arg, &node, sizeof(int)); 
+
+            if (retval)
+                return -EFAULT; 
+        break; 
+
+        case IO_FIFO_RESET_STATS: 
+            // Zero the statistics shown in the stats sys/class file. 
+            fifo_reset_counters(fifo); 
+        break; 
+
+        case IO_FIFO_NOTIFY: 
+            // A process moved a cursor through the mapped control page, wake 
+            // up the readers and writers it unblocked. 
+            fifo_notify(fifo); 
+        break; 
+
+        default: 
+            return -ENOTTY; 
+    }
+
+    return 0; 
+}
+
+
+long int fifo_ctl_ioctl(struct file *fp, unsigned int cmd, unsigned long arg)
+{
+    int retval; 
+    int minor; 
+
+    switch(cmd)
+    {
+        case IO_FIFO_CTL_CREATE: 
+            // Create a device on the wanted minor, or on the first free one 
+            // when negative, and send its minor back to the userspace. 
+            retval = copy_from_user(&minor, (int __user *)arg, sizeof(int)); 
+
+            if (retval)
+                return -EFAULT; 
+
+            minor = fifo_create(minor); 
+
+            if (minor < 0)
+                return minor; 
+
+            retval = copy_to_user((int __user *)arg, &minor, sizeof(int)); 
+
+            if (retval)
+            {
+                fifo_destroy(minor); 
+                return -EFAULT;
+            }
+        break; 
+
+        case IO_FIFO_CTL_DESTROY: 
+            // Destroy a closed device. 
+            retval = copy_from_user(&minor, (int __user *)arg, sizeof(int)); 
+
+            if (retval)
+                return -EFAULT; 
+
+            if (minor < 0)
+                return -ENODEV; 
+
+            return fifo_destroy(minor); 
+
         default: 
             return -ENOTTY; 
     }
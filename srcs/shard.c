@@ -0,0 +1,490 @@
+#include "shard.h"
+#include "fifo_trace.h"
+
+
+// * _ SHARD RINGS _____________________________________________________________
+
+int fifo_shard_init(FIFO_t* fifo)
+{
+    FIFO_shard_t*   shards; 
+    unsigned int    cpu; 
+
+    if (fifo->shards)
+        return 0; 
+
+    shards = kvcalloc(nr_cpu_ids, sizeof(FIFO_shard_t), GFP_KERNEL); 
+    if (!shards)
+        return -ENOMEM; 
+
+    for (cpu = 0; cpu < nr_cpu_ids; cpu += 1)
+        mutex_init(&(shards[cpu].w_mutex)); 
+
+    // Readers and pollers look at the rings without shard_sem. 
+    fifo->shard_next = 0; 
+    smp_store_release(&(fifo->shards), shards); 
+    return 0; 
+}
+
+
+void fifo_shard_release(FIFO_t* fifo)
+{
+    unsigned char*  buffer; 
+    unsigned int    cpu; 
+
+    if (!fifo->shards)
+        return; 
+
+    // Writers sleeping for space look at the buffer pointer, never into it. 
+    for (cpu = 0; cpu < nr_cpu_ids; cpu += 1)
+    {
+        buffer = fifo->shards[cpu].buffer; 
+        WRITE_ONCE(fifo->shards[cpu].buffer, NULL); 
+        kvfree(buffer); 
+    }
+}
+
+
+void fifo_shard_reset(FIFO_t* fifo)
+{
+    unsigned int    cpu; 
+
+    if (!fifo->shards)
+        return; 
+
+    for (cpu = 0; cpu < nr_cpu_ids; cpu += 1)
+        ring_rewind(&(fifo->shards[cpu].ctl)); 
+}
+
+
+void fifo_shard_destroy(FIFO_t* fifo)
+{
+    fifo_shard_release(fifo); 
+    kvfree(fifo->shards); 
+}
+
+
+/// @brief Return the number of bytes stored in the ring of a CPU. 
+/// @param shard ring of the CPU. 
+/// @return the used space in bytes, 0 if its buffer is not allocated. 
+static unsigned int fifo_shard_used_one(FIFO_shard_t* shard)
+{
+    // Its cursors and size are set before its buffer is published. 
+    if (!smp_load_acquire(&(shard->buffer)))
+        return 0; 
+
+    return ring_used(
+        READ_ONCE(shard->ctl.r_cur), smp_load_acquire(&(shard->ctl.w_cur)), READ_ONCE(shard->ctl.size)
+    ); 
+}
+
+
+unsigned int fifo_shard_used(FIFO_t* fifo)
+{
+    FIFO_shard_t*   shards; 
+    unsigned int    used; 
+    unsigned int    cpu; 
+
+    shards = smp_load_acquire(&(fifo->shards)); 
+    if (!shards)
+        return 0; 
+
+    used = 0; 
+    for (cpu = 0; cpu < nr_cpu_ids; cpu += 1)
+        used += fifo_shard_used_one(&(shards[cpu])); 
+
+    return used; 
+}
+
+
+bool fifo_shard_readable(FIFO_t* fifo)
+{
+    FIFO_shard_t*   shards; 
+    unsigned int    cpu; 
+
+    if (fifo_get_used_space(fifo))
+        return true; 
+
+    shards = smp_load_acquire(&(fifo->shards)); 
+    if (!shards)
+        return false; 
+
+    for (cpu = 0; cpu < nr_cpu_ids; cpu += 1)
+    {
+        if (fifo_shard_used_one(&(shards[cpu])))
+            return true; 
+    }
+
+    return false; 
+}
+
+
+// * _ READER __________________________________________________________________
+
+bool fifo_shard_pick(FIFO_t* fifo, FIFO_source_t* src)
+{
+    FIFO_shard_t*   shard; 
+    unsigned int    r_cur; 
+    unsigned int    w_cur; 
+    unsigned int    used; 
+    unsigned int    cpu; 
+    unsigned int    i; 
+    u64             stamp; 
+    u64             oldest; 
+    bool            found; 
+
+    // Messages written to the main ring while the device entered sharded mode 
+    // are older than any stored in the rings of the CPUs. 
+    r_cur = fifo->ring->r_cur; 
+    w_cur = smp_load_acquire(&(fifo->ring->w_cur)); 
+    if (ring_used(r_cur, w_cur, fifo->size))
+    {
+        *src = (FIFO_source_t){ 
+            .ctl = fifo->ring, .buffer = fifo->buffer, .size = fifo->size, 
+            .header = FIFO_RECORD_HEADER, .r_cur = r_cur, .w_cur = w_cur, .cpu = nr_cpu_ids, 
+        }; 
+        return true; 
+    }
+
+    // Start after the last ring read, so a busy CPU never starves the others. 
+    found = false; 
+    oldest = 0; 
+    for (i = 0; i < nr_cpu_ids; i += 1)
+    {
+        cpu = (fifo->shard_next + i) % nr_cpu_ids; 
+        shard = &(fifo->shards[cpu]); 
+        if (!smp_load_acquire(&(shard->buffer)))
+            continue; 
+
+        // Every byte behind the write cursor we load is visible. 
+        r_cur = shard->ctl.r_cur; 
+        w_cur = smp_load_acquire(&(shard->ctl.w_cur)); 
+        used = ring_used(r_cur, w_cur, shard->ctl.size); 
+        if (!used)
+            continue; 
+
+        // In ordered mode, keep the ring whose next message was written 
+        // first. A header too short to hold its stamp is read first, to 
+        // report it. 
+        stamp = 0; 
+        if (used >= FIFO_SHARD_HEADER)
+            ring_peek(shard->buffer, shard->ctl.size, r_cur + RING_RECORD_HEADER, &stamp, sizeof(u64)); 
+
+        if (found && stamp >= oldest)
+            continue; 
+
+        *src = (FIFO_source_t){ 
+            .ctl = &(shard->ctl), .buffer = shard->buffer, .size = shard->ctl.size, 
+            .header = FIFO_SHARD_HEADER, .r_cur = r_cur, .w_cur = w_cur, .cpu = cpu, 
+        }; 
+        oldest = stamp; 
+        found = true; 
+
+        if (!(fifo->mode & FIFO_MODE_ORDERED))
+            break; 
+    }
+
+    return found; 
+}
+
+
+int fifo_shard_length(FIFO_source_t* src)
+{
+    unsigned int    used; 
+    int             len; 
+
+    // The length comes first in both headers, the stamp has to fit as well. 
+    used = ring_used(src->r_cur, src->w_cur, src->size); 
+    len = ring_record_length(src->buffer, src->size, src->r_cur, used); 
+    if (len >= 0 && (used < src->header || len > used - src->header))
+        return -EIO; 
+
+    return len; 
+}
+
+
+int fifo_shard_next_size(FIFO_t* fifo)
+{
+    FIFO_source_t   src; 
+
+    if (!fifo_shard_pick(fifo, &src))
+        return 0; 
+
+    return fifo_shard_length(&src); 
+}
+
+
+ssize_t fifo_shard_read(FIFO_t* fifo, struct iov_iter* to, size_t nbc, bool nowait, bool* sharded)
+{
+    FIFO_source_t   src; 
+    unsigned int    r_next; 
+    unsigned int    r_pos; 
+    size_t          first_seg; 
+    size_t          copied; 
+    int             lock; 
+    int             len; 
+
+    *sharded = true; 
+    while (true)
+    {
+        lock = nowait ? fifo_read_trylock(fifo) : fifo_read_lock(fifo); 
+        if (lock < 0)
+            return lock; 
+
+        // The mode only changes with the read side taken. 
+        if (!(fifo->mode & FIFO_MODE_SHARDED))
+        {
+            fifo_read_unlock(fifo, lock); 
+            *sharded = false; 
+            return 0; 
+        }
+
+        if (fifo_shard_pick(fifo, &src))
+            break; 
+
+        fifo_read_unlock(fifo, lock); 
+        FIFO_COUNT(fifo, empty, 1); 
+
+        if (nowait)
+            return -EAGAIN; 
+
+        // Every writer wakes us up once its message is published, in any 
+        // ring. Leaving sharded mode wakes us up too. 
+        if (FIFO_WAIT_EVENT(fifo, 
+            fifo->r_wait, 
+            fifo_shard_readable(fifo) || !(READ_ONCE(fifo->mode) & FIFO_MODE_SHARDED)
+        ))
+            return -ERESTARTSYS; 
+    }
+
+    // A message too large for the request stays in its ring. 
+    len = fifo_shard_length(&src); 
+    if (len >= 0 && len > nbc)
+        len = -EMSGSIZE; 
+
+    if (len < 0)
+    {
+        fifo_read_unlock(fifo, lock); 
+        return len; 
+    }
+
+    r_pos = (src.r_cur + src.header) & (src.size - 1); 
+    first_seg = min((size_t)len, (size_t)(src.size - r_pos)); 
+
+    copied = copy_to_iter(src.buffer + r_pos, first_seg, to); 
+    if (copied == first_seg)
+        copied += copy_to_iter(src.buffer, len - first_seg, to); 
+
+    if (copied != len)
+    {
+        iov_iter_revert(to, copied); 
+        fifo_read_unlock(fifo, lock); 
+        return -EFAULT; 
+    }
+
+    // Give the space back to the writers of that ring, and read the next ring 
+    // first next time. 
+    r_next = src.r_cur + src.header + len; 
+    smp_store_release(&(src.ctl->r_cur), r_next); 
+    if (src.cpu < nr_cpu_ids)
+        fifo->shard_next = src.cpu + 1; 
+
+    trace_fifo_dequeue(fifo->minor, len, r_next, src.w_cur); 
+    FIFO_COUNT(fifo, r_bytes, len); 
+    FIFO_COUNT(fifo, r_ops, 1); 
+    FIFO_NOTE_CPU(fifo, r_cpu); 
+
+    // The writers of every CPU share the wait queue, wake them all once this 
+    // ring dropped to the low watermark: only those of its CPU go on. The 
+    // used space is computed against the write cursor we loaded, so it can 
+    // only be over-estimated. 
+    if (wq_has_sleeper(&(fifo->w_wait)) &&
+        ring_used(r_next, src.w_cur, src.size) <= READ_ONCE(fifo->lowat))
+        wake_up_interruptible_all(&(fifo->w_wait)); 
+
+    fifo_read_unlock(fifo, lock); 
+    return len; 
+}
+
+
+// * _ WRITERS _________________________________________________________________
+
+/// @brief Allocate the buffer of the ring of a CPU, on the memory node of 
+///        that CPU, with its mutex held. 
+/// @param fifo  pointer to a fifo structure. 
+/// @param shard ring of the CPU. 
+/// @param cpu   the CPU. 
+/// @return 0 if no error occurred, -ENOMEM otherwise. 
+static int fifo_shard_alloc(FIFO_t* fifo, FIFO_shard_t* shard, unsigned int cpu)
+{
+    unsigned char*  buffer; 
+
+    buffer = kvmalloc_node(fifo->size, GFP_KERNEL, cpu_to_node(cpu)); 
+    if (!buffer)
+        return -ENOMEM; 
+
+    // The cursors and size are set before the buffer is published. 
+    ring_rewind(&(shard->ctl)); 
+    shard->ctl.size = fifo->size; 
+    smp_store_release(&(shard->buffer), buffer); 
+    return 0; 
+}
+
+
+/// @brief Check whether a message fits in the ring of a CPU, for a writer 
+///        waiting without shard_sem: a ring freed meanwhile will be allocated 
+///        again, empty. 
+/// @param shard ring of the CPU. 
+/// @param len   number of bytes needed, header included. 
+/// @return true if the writer can go on. 
+static bool fifo_shard_writable(FIFO_shard_t* shard, unsigned int len)
+{
+    unsigned int    size; 
+
+    size = READ_ONCE(shard->ctl.size); 
+    return !READ_ONCE(shard->buffer) || size - fifo_shard_used_one(shard) >= len || len > size; 
+}
+
+
+ssize_t fifo_shard_write(FIFO_t* fifo, struct iov_iter* from, size_t nbc, bool nowait, bool* sharded)
+{
+    FIFO_shard_t*   shard; 
+    unsigned int    cpu; 
+    unsigned int    len; 
+    unsigned int    used; 
+    unsigned int    r_cur; 
+    unsigned int    w_cur; 
+    unsigned int    w_pos; 
+    size_t          first_seg; 
+    size_t          copied; 
+    u64             stamp; 
+    int             retval; 
+
+    *sharded = true; 
+    if (!nbc)
+        return 0; 
+
+    while (true)
+    {
+        // Only a reset, a resize or a mode change takes shard_sem for 
+        // writing, the writers of every CPU share it for reading. 
+        if (nowait)
+        {
+            if (!percpu_down_read_trylock(&(fifo->shard_sem)))
+                return -EAGAIN; 
+        }
+
+        else
+            percpu_down_read(&(fifo->shard_sem)); 
+
+        if (!(fifo->mode & FIFO_MODE_SHARDED))
+        {
+            percpu_up_read(&(fifo->shard_sem)); 
+            *sharded = false; 
+            return 0; 
+        }
+
+        // The writers of this CPU wait for each other, only the reader 
+        // touches the ring besides them. Moving to another CPU while waiting 
+        // just spreads the message to a neighbour ring. 
+        cpu = raw_smp_processor_id(); 
+        shard = &(fifo->shards[cpu]); 
+        if (nowait ? !mutex_trylock(&(shard->w_mutex)) : mutex_lock_interruptible(&(shard->w_mutex)))
+        {
+            percpu_up_read(&(fifo->shard_sem)); 
+            return nowait ? -EAGAIN : -ERESTARTSYS; 
+        }
+
+        retval = 0; 
+        if (!shard->buffer)
+            retval = fifo_shard_alloc(fifo, shard, cpu); 
+
+        if (!retval && nbc > shard->ctl.size - FIFO_SHARD_HEADER)
+            retval = -EMSGSIZE; 
+
+        if (retval)
+        {
+            mutex_unlock(&(shard->w_mutex)); 
+            percpu_up_read(&(fifo->shard_sem)); 
+            return retval; 
+        }
+
+        // Only the reader of the device writes the read cursor, the copy of 
+        // this ring spares us its cache line while there is room. 
+        len = nbc; 
+        w_cur = shard->ctl.w_cur; 
+        used = ring_write_used(&(shard->ctl), w_cur, shard->ctl.size, len + FIFO_SHARD_HEADER); 
+        r_cur = shard->ctl.r_cache; 
+        if (shard->ctl.size - used >= len + FIFO_SHARD_HEADER)
+            break; 
+
+        mutex_unlock(&(shard->w_mutex)); 
+        percpu_up_read(&(fifo->shard_sem)); 
+        FIFO_COUNT(fifo, full, 1); 
+
+        if (nowait)
+            return -EAGAIN; 
+
+        trace_fifo_writer_block(fifo->minor, len + FIFO_SHARD_HEADER, r_cur, w_cur); 
+        if (FIFO_WAIT_EVENT(fifo, fifo->w_wait, fifo_shard_writable(shard, len + FIFO_SHARD_HEADER)))
+            return -ERESTARTSYS; 
+
+        trace_fifo_writer_wake(fifo->minor, READ_ONCE(shard->ctl.size) - fifo_shard_used_one(shard), r_cur, w_cur); 
+    }
+
+    // Copy the message after the room left for its header. Nothing is 
+    // published on a fault, so the reader never sees a partial message. 
+    w_pos = (w_cur + FIFO_SHARD_HEADER) & (shard->ctl.size - 1); 
+    first_seg = min((size_t)len, (size_t)(shard->ctl.size - w_pos)); 
+
+    copied = copy_from_iter(shard->buffer + w_pos, first_seg, from); 
+    if (copied == first_seg)
+        copied += copy_from_iter(shard->buffer, len - first_seg, from); 
+
+    if (copied != len)
+    {
+        mutex_unlock(&(shard->w_mutex)); 
+        percpu_up_read(&(fifo->shard_sem)); 
+        return -EFAULT; 
+    }
+
+    // Stamp the message once copied, the order across rings is the order 
+    // the messages became whole. Publish the header and the message together. 
+    stamp = ktime_get_ns(); 
+    ring_poke(shard->buffer, shard->ctl.size, w_cur, &len, RING_RECORD_HEADER); 
+    ring_poke(shard->buffer, shard->ctl.size, w_cur + RING_RECORD_HEADER, &stamp, sizeof(u64)); 
+    smp_store_release(&(shard->ctl.w_cur), w_cur + FIFO_SHARD_HEADER + len); 
+    mutex_unlock(&(shard->w_mutex)); 
+    percpu_up_read(&(fifo->shard_sem)); 
+
+    trace_fifo_enqueue(fifo->minor, len, r_cur, w_cur + FIFO_SHARD_HEADER + len); 
+    FIFO_COUNT(fifo, w_bytes, len); 
+    FIFO_COUNT(fifo, w_ops, 1); 
+
+    // The barrier in wq_has_sleeper(), paired with the one of a sleeper or a 
+    // poller, makes sure the reader sees the cursor moved before the call. 
+    if (wq_has_sleeper(&(fifo->r_wait)))
+        wake_up_interruptible_poll(&(fifo->r_wait), EPOLLIN | EPOLLRDNORM); 
+
+    return len; 
+}
+
+
+__poll_t fifo_shard_poll(FIFO_t* fifo)
+{
+    FIFO_shard_t*   shards; 
+    FIFO_shard_t*   shard; 
+    __poll_t        mask; 
+
+    mask = 0; 
+    if (fifo_shard_readable(fifo))
+        mask |= EPOLLIN | EPOLLRDNORM; 
+
+    // The next write most likely runs on this CPU, an unallocated ring is 
+    // empty. 
+    shards = smp_load_acquire(&(fifo->shards)); 
+    shard = shards ? &(shards[raw_smp_processor_id()]) : NULL; 
+    if (!shard || fifo_shard_used_one(shard) <= READ_ONCE(fifo->lowat))
+        mask |= EPOLLOUT | EPOLLWRNORM; 
+
+    return mask; 
+}
@@ -0,0 +1,623 @@
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <libgen.h>
+
+#include "ring.h"
+
+// * _ BENCHMARK SETTINGS ______________________________________________________
+#define BENCH_MSGS      200000
+#define BENCH_THREADS   4
+#define BENCH_POLL_MS   10
+#define BENCH_HUGE_PAGE (2 * 1024 * 1024)
+
+// Message sizes and ring sizes of the runs, in bytes. A message starts with 
+// its send time, so it holds at least 8 bytes. 
+static const unsigned int msg_sizes[] = { 16, 64, 512, 4096 }; 
+static const unsigned int ring_sizes[] = { 4096, 65536, 1048576, 4194304, 16777216 }; 
+
+// * _ STRUCTURE DEFINITIONS ___________________________________________________
+
+/// @brief A ring under test, either in memory through the ring core or a 
+/// FIFO device. Like in the driver, each side is owned by a single thread at 
+/// a time, through its mutex once it has several threads. pages tells the 
+/// pages backing its buffer: 4K, 2M, mixed or ? when unknown. 
+typedef struct bench_ring_t
+{
+    FIFO_ring_t         ctl; 
+    unsigned char*      buffer; 
+    unsigned int        size; 
+    const char*         pages; 
+    pthread_mutex_t     r_mutex; 
+    pthread_mutex_t     w_mutex; 
+    const char*         device; 
+}   BENCH_ring_t; 
+
+
+/// @brief One run: a workload moving msgs messages of msg_size bytes. 
+/// consumed counts the messages received, latencies holds the time each one 
+/// spent between its write and its read, in nanoseconds. 
+typedef struct bench_run_t
+{
+    BENCH_ring_t*       ring; 
+    unsigned int        msg_size; 
+    unsigned int        producers; 
+    unsigned int        consumers; 
+    unsigned int        msgs; 
+    unsigned int        consumed; 
+    long long*          latencies; 
+}   BENCH_run_t; 
+
+
+// * _ FUNCTION DEFINITIONS ____________________________________________________
+long long   now_ns(void); 
+int         bench_write(BENCH_run_t* run, int fd, unsigned char* msg); 
+int         bench_read(BENCH_run_t* run, int fd, unsigned char* msg); 
+void*       producer(void* arg); 
+void*       consumer(void* arg); 
+int         single(BENCH_run_t* run); 
+int         run_threads(BENCH_run_t* run); 
+int         setup_ring(BENCH_ring_t* ring, unsigned int size, int huge); 
+const char* memory_pages(BENCH_ring_t* ring); 
+const char* device_pages(BENCH_ring_t* ring); 
+int         misses_open(void); 
+long long   misses_close(int fd); 
+void        report(const char* name, BENCH_run_t* run, double elapsed, long long misses); 
+int         compare(const void* a, const void* b); 
+
+
+
+/// Run every workload, single thread, SPSC and MPMC, for every message size 
+/// and ring size. Without argument, the rings are in memory and go through 
+/// the ring core of the driver. With a device path, the same workloads run 
+/// against that device, in record mode, on the pages its module gives it. 
+/// In memory, the rings of 2MB and more run twice: on 4KB pages, then on 2MB 
+/// pages when the kernel has transparent huge pages. The cache misses of each 
+/// run are counted when perf events are available, per MB moved. 
+int main(int argc, char** argv)
+{
+    struct timespec start; 
+    struct timespec end; 
+    BENCH_ring_t    ring; 
+    BENCH_run_t     run; 
+    unsigned int    old_size; 
+    unsigned int    p; 
+    unsigned int    r; 
+    unsigned int    m; 
+    unsigned int    w; 
+    long long       misses; 
+    int             huge; 
+    int             old_mode; 
+    int             perf_fd; 
+    int             fd; 
+    int             retval; 
+
+    memset(&ring, 0, sizeof(BENCH_ring_t)); 
+    pthread_mutex_init(&(ring.r_mutex), NULL); 
+    pthread_mutex_init(&(ring.w_mutex), NULL); 
+    ring.device = argc > 1 ? argv[1] : NULL; 
+
+    // Save the device settings to give them back once done. 
+    fd = -1; 
+    if (ring.device)
+    {
+        fd = open(ring.device, O_RDWR); 
+        if (fd < 0 || ioctl(fd, IO_FIFO_GET_SIZE, &old_size) || ioctl(fd, IO_FIFO_GET_MODE, &old_mode))
+        {
+            printf("Error occurred while opening %s...\n", ring.device); 
+            return -1; 
+        }
+    }
+
+    run.ring = &ring; 
+    run.msgs = BENCH_MSGS; 
+    run.latencies = (long long*)malloc(sizeof(long long) * BENCH_MSGS); 
+    if (!run.latencies)
+        return -1; 
+
+    printf(
+        "%-6s %-6s %8s %9s %5s %12s %10s %9s %9s %9s %9s %10s\n",
+        "target", "load", "msg (B)", "ring (B)", "pages", "msg/s", "MB/s",
+        "p50 (us)", "p99 (us)", "p99.9", "max (us)", "misses/MB"
+    ); 
+
+    retval = 0; 
+    for (p = 0; p < 2 * sizeof(ring_sizes) / sizeof(ring_sizes[0]) && !retval; p += 1)
+    {
+        // Each ring size on 4KB pages, then on 2MB pages when it spans one. 
+        r = p / 2; 
+        huge = p % 2; 
+        if (huge && (ring.device || ring_sizes[r] < BENCH_HUGE_PAGE))
+            continue; 
+
+        if (setup_ring(&ring, ring_sizes[r], huge))
+        {
+            printf("~Can't get a %u bytes ring, skipped.\n", ring_sizes[r]); 
+            continue; 
+        }
+
+        for (m = 0; m < sizeof(msg_sizes) / sizeof(msg_sizes[0]) && !retval; m += 1)
+        {
+            // A message must fit whole with its header. 
+            if (msg_sizes[m] + RING_RECORD_HEADER > ring.size)
+                continue; 
+
+            run.msg_size = msg_sizes[m]; 
+
+            // Single thread: write a message then read it back. Then one 
+            // producer and one consumer, then BENCH_THREADS of each. 
+            for (w = 0; w < 3 && !retval; w += 1)
+            {
+                run.producers = w == 2 ? BENCH_THREADS : 1; 
+                run.consumers = w == 2 ? BENCH_THREADS : 1; 
+                run.consumed = 0; 
+
+                perf_fd = misses_open(); 
+                clock_gettime(CLOCK_MONOTONIC, &start); 
+                retval = w ? run_threads(&run) : single(&run); 
+                clock_gettime(CLOCK_MONOTONIC, &end); 
+                misses = misses_close(perf_fd); 
+
+                if (!retval)
+                    report(
+                        w == 0 ? "single" : (w == 1 ? "spsc" : "mpmc"), &run,
+                        (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9, misses
+                    ); 
+            }
+        }
+    }
+
+    if (retval)
+        printf("~Benchmark stopped on error: %s.\n", strerror(-retval)); 
+
+    free(ring.buffer); 
+    free(run.latencies); 
+
+    if (fd >= 0)
+    {
+        ioctl(fd, IO_FIFO_RESET); 
+        ioctl(fd, IO_FIFO_SET_SIZE, &old_size); 
+        ioctl(fd, IO_FIFO_SET_MODE, &old_mode); 
+        close(fd); 
+    }
+
+    return retval ? -1 : 0; 
+}
+
+
+long long now_ns(void)
+{
+    struct timespec ts; 
+
+    clock_gettime(CLOCK_MONOTONIC, &ts); 
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec; 
+}
+
+
+/// Prepare an empty ring of the given size: a buffer for the ring core, on 
+/// 2MB pages if huge is set, or the device resized and switched to record 
+/// mode. 
+int setup_ring(BENCH_ring_t* ring, unsigned int size, int huge)
+{
+    void*   buffer; 
+    int     mode; 
+    int     fd; 
+
+    ring_rewind(&(ring->ctl)); 
+    ring->size = size; 
+
+    // Aligned on a 2MB page so the kernel can back it with whole ones, and 
+    // touched now so no page is faulted in during the runs. 
+    if (!ring->device)
+    {
+        free(ring->buffer); 
+        ring->buffer = NULL; 
+        if (posix_memalign(&buffer, BENCH_HUGE_PAGE, size))
+            return -1; 
+
+        madvise(buffer, size, huge ? MADV_HUGEPAGE : MADV_NOHUGEPAGE); 
+        memset(buffer, 0, size); 
+        ring->buffer = (unsigned char*)buffer; 
+        ring->pages = memory_pages(ring); 
+        return 0; 
+    }
+
+    fd = open(ring->device, O_RDWR); 
+    if (fd < 0)
+        return -1; 
+
+    mode = FIFO_MODE_RECORD; 
+    ioctl(fd, IO_FIFO_RESET); 
+    if (ioctl(fd, IO_FIFO_SET_SIZE, &(ring->size)) || ioctl(fd, IO_FIFO_SET_MODE, &mode))
+    {
+        close(fd); 
+        return -1; 
+    }
+
+    close(fd); 
+    ring->pages = device_pages(ring); 
+    return 0; 
+}
+
+
+/// Tell the pages backing the buffer of an in-memory ring, from the huge 
+/// pages the kernel counts in the mapping holding it. 
+const char* memory_pages(BENCH_ring_t* ring)
+{
+    unsigned long   start; 
+    unsigned long   end; 
+    unsigned long   addr; 
+    unsigned long   huge_kb; 
+    char            line[256]; 
+    FILE*           smaps; 
+    int             found; 
+
+    smaps = fopen("/proc/self/smaps", "r"); 
+    if (!smaps)
+        return "?"; 
+
+    addr = (unsigned long)ring->buffer; 
+    found = 0; 
+    huge_kb = 0; 
+    while (fgets(line, sizeof(line), smaps))
+    {
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2)
+            found = addr >= start && addr < end; 
+
+        else if (found && sscanf(line, "AnonHugePages: %lu kB", &huge_kb) == 1)
+            break; 
+    }
+
+    fclose(smaps); 
+    if (!huge_kb)
+        return "4K"; 
+
+    return huge_kb * 1024 >= ring->size ? "2M" : "mixed"; 
+}
+
+
+/// Tell the pages backing the buffer of a device, from its backing sysfs file. 
+const char* device_pages(BENCH_ring_t* ring)
+{
+    char    path[256]; 
+    char    name[256]; 
+    char    backing[16]; 
+    FILE*   file; 
+    int     retval; 
+
+    snprintf(name, sizeof(name), "%s", ring->device); 
+    snprintf(path, sizeof(path), "/sys/class/fifo/%s/backing", basename(name)); 
+    file = fopen(path, "r"); 
+    if (!file)
+        return "?"; 
+
+    retval = fscanf(file, "%15s", backing); 
+    fclose(file); 
+    if (retval != 1)
+        return "?"; 
+
+    if (!strcmp(backing, "huge"))
+        return "2M"; 
+
+    return strcmp(backing, "partial") ? "4K" : "mixed"; 
+}
+
+
+/// Write one message, waiting for space. In memory, the caller spins while 
+/// the ring is full since there is nothing to sleep on. 
+int bench_write(BENCH_run_t* run, int fd, unsigned char* msg)
+{
+    BENCH_ring_t*   ring; 
+    int             retval; 
+
+    ring = run->ring; 
+    if (ring->device)
+        return write(fd, msg, run->msg_size) == run->msg_size ? 0 : -errno; 
+
+    while (true)
+    {
+        if (run->producers > 1)
+            pthread_mutex_lock(&(ring->w_mutex)); 
+
+        retval = ring_write(&(ring->ctl), ring->buffer, ring->size, msg, run->msg_size, true); 
+
+        if (run->producers > 1)
+            pthread_mutex_unlock(&(ring->w_mutex)); 
+
+        if (retval != -EAGAIN)
+            return retval < 0 ? retval : 0; 
+
+        sched_yield(); 
+    }
+}
+
+
+/// Read one message without waiting. 
+/// Return 0 once read, -EAGAIN if none is there yet, negative otherwise. 
+int bench_read(BENCH_run_t* run, int fd, unsigned char* msg)
+{
+    BENCH_ring_t*   ring; 
+    ssize_t         len; 
+    int             retval; 
+
+    ring = run->ring; 
+    if (ring->device)
+    {
+        len = read(fd, msg, run->msg_size); 
+        if (len < 0)
+            return -errno; 
+
+        return len == run->msg_size ? 0 : -EIO; 
+    }
+
+    if (run->consumers > 1)
+        pthread_mutex_lock(&(ring->r_mutex)); 
+
+    retval = ring_read(&(ring->ctl), ring->buffer, ring->size, msg, run->msg_size, true); 
+
+    if (run->consumers > 1)
+        pthread_mutex_unlock(&(ring->r_mutex)); 
+
+    if (retval < 0)
+        return retval; 
+
+    return (unsigned int)retval == run->msg_size ? 0 : -EIO; 
+}
+
+
+/// Write a message after another on the same ring, then read it back, and 
+/// time each pair. 
+int single(BENCH_run_t* run)
+{
+    unsigned char   msg[msg_sizes[sizeof(msg_sizes) / sizeof(msg_sizes[0]) - 1]]; 
+    long long       sent; 
+    unsigned int    i; 
+    int             retval; 
+    int             fd; 
+
+    fd = -1; 
+    if (run->ring->device)
+    {
+        fd = open(run->ring->device, O_RDWR); 
+        if (fd < 0)
+            return -errno; 
+    }
+
+    memset(msg, 0, sizeof(msg)); 
+    retval = 0; 
+    for (i = 0; i < run->msgs && !retval; i += 1)
+    {
+        sent = now_ns(); 
+        retval = bench_write(run, fd, msg); 
+        if (!retval)
+            retval = bench_read(run, fd, msg); 
+
+        run->latencies[i] = now_ns() - sent; 
+    }
+
+    if (fd >= 0)
+        close(fd); 
+
+    run->consumed = i; 
+    return retval; 
+}
+
+
+void* producer(void* arg)
+{
+    BENCH_run_t*    run; 
+    unsigned char   msg[msg_sizes[sizeof(msg_sizes) / sizeof(msg_sizes[0]) - 1]]; 
+    long long       sent; 
+    unsigned int    i; 
+    int             fd; 
+
+    run = arg; 
+    fd = -1; 
+    if (run->ring->device)
+    {
+        fd = open(run->ring->device, O_WRONLY); 
+        if (fd < 0)
+            return (void*)(long)-errno; 
+    }
+
+    // Each message carries its send time, the consumer measures its latency. 
+    memset(msg, 0, sizeof(msg)); 
+    for (i = 0; i < run->msgs / run->producers; i += 1)
+    {
+        sent = now_ns(); 
+        memcpy(msg, &sent, sizeof(long long)); 
+        if (bench_write(run, fd, msg))
+            break; 
+    }
+
+    if (fd >= 0)
+        close(fd); 
+
+    return (void*)(long)(i == run->msgs / run->producers ? 0 : -EIO); 
+}
+
+
+void* consumer(void* arg)
+{
+    BENCH_run_t*    run; 
+    struct pollfd   pfd; 
+    unsigned char   msg[msg_sizes[sizeof(msg_sizes) / sizeof(msg_sizes[0]) - 1]]; 
+    long long       sent; 
+    unsigned int    index; 
+    int             retval; 
+
+    run = arg; 
+    pfd.fd = -1; 
+    pfd.events = POLLIN; 
+
+    // Devices are read without blocking, a consumer sleeping in read() would 
+    // never see the others took the last messages. 
+    if (run->ring->device)
+    {
+        pfd.fd = open(run->ring->device, O_RDONLY | O_NONBLOCK); 
+        if (pfd.fd < 0)
+            return (void*)(long)-errno; 
+    }
+
+    retval = 0; 
+    while (__atomic_load_n(&(run->consumed), __ATOMIC_RELAXED) < run->msgs)
+    {
+        retval = bench_read(run, pfd.fd, msg); 
+        if (retval == -EAGAIN)
+        {
+            if (pfd.fd >= 0)
+                poll(&pfd, 1, BENCH_POLL_MS); 
+
+            else
+                sched_yield(); 
+
+            retval = 0; 
+            continue; 
+        }
+
+        if (retval)
+            break; 
+
+        memcpy(&sent, msg, sizeof(long long)); 
+        index = __atomic_fetch_add(&(run->consumed), 1, __ATOMIC_RELAXED); 
+        run->latencies[index] = now_ns() - sent; 
+    }
+
+    if (pfd.fd >= 0)
+        close(pfd.fd); 
+
+    return (void*)(long)retval; 
+}
+
+
+/// Start the producers and consumers of a run and wait for all of them. 
+int run_threads(BENCH_run_t* run)
+{
+    pthread_t       threads[2 * BENCH_THREADS]; 
+    void*           status; 
+    unsigned int    count; 
+    unsigned int    i; 
+    int             retval; 
+
+    count = 0; 
+    for (i = 0; i < run->consumers; i += 1)
+        if (!pthread_create(&(threads[count]), NULL, consumer, run))
+            count += 1; 
+
+    for (i = 0; i < run->producers; i += 1)
+        if (!pthread_create(&(threads[count]), NULL, producer, run))
+            count += 1; 
+
+    // A thread that could not start would leave the others waiting forever. 
+    if (count != run->consumers + run->producers)
+    {
+        printf("~Can't start the benchmark threads.\n"); 
+        exit(-1); 
+    }
+
+    retval = 0; 
+    for (i = 0; i < count; i += 1)
+    {
+        pthread_join(threads[i], &status); 
+        if (status)
+            retval = (int)(long)status; 
+    }
+
+    return retval; 
+}
+
+
+int compare(const void* a, const void* b)
+{
+    long long x; 
+    long long y; 
+
+    x = *(const long long*)a; 
+    y = *(const long long*)b; 
+    return (x > y) - (x < y); 
+}
+
+
+/// Start counting the cache misses of this thread and of the threads it 
+/// starts from now on, in the kernel too when allowed. Returns the counter, 
+/// -1 if perf events are not available. 
+int misses_open(void)
+{
+    struct perf_event_attr  attr; 
+    int                     fd; 
+
+    memset(&attr, 0, sizeof(struct perf_event_attr)); 
+    attr.size = sizeof(struct perf_event_attr); 
+    attr.type = PERF_TYPE_HARDWARE; 
+    attr.config = PERF_COUNT_HW_CACHE_MISSES; 
+    attr.inherit = 1; 
+
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0); 
+    if (fd >= 0)
+        return fd; 
+
+    // Without the rights to watch the kernel, count the user space only. 
+    attr.exclude_kernel = 1; 
+    attr.exclude_hv = 1; 
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0); 
+}
+
+
+/// Read and close a counter opened by misses_open. Returns the misses 
+/// counted, -1 if there is no counter. 
+long long misses_close(int fd)
+{
+    long long   misses; 
+
+    if (fd < 0)
+        return -1; 
+
+    if (read(fd, &misses, sizeof(misses)) != sizeof(misses))
+        misses = -1; 
+
+    close(fd); 
+    return misses; 
+}
+
+
+/// Print the throughput of a run, the percentiles of its latencies and its cache misses 
+/// per MB moved. 
+void report(const char* name, BENCH_run_t* run, double elapsed, long long misses)
+{
+    long long*  lat; 
+    char        per_mb[32]; 
+    size_t      n; 
+
+    lat = run->latencies; 
+    n = run->consumed < run->msgs ? run->consumed : run->msgs; 
+    if (!n)
+        return; 
+
+    qsort(lat, n, sizeof(long long), compare); 
+
+    if (misses < 0)
+        snprintf(per_mb, sizeof(per_mb), "-"); 
+
+    else
+        snprintf(per_mb, sizeof(per_mb), "%.0f", misses / (n * (double)run->msg_size / 1e6)); 
+
+    printf(
+        "%-6s %-6s %8u %9u %5s %12.0f %10.1f %9.2f %9.2f %9.2f %9.2f %10s\n",
+        run->ring->device ? "device" : "memory", name, run->msg_size, run->ring->size, run->ring->pages,
+        n / elapsed, n * (double)run->msg_size / elapsed / 1e6,
+        lat[n / 2] / 1e3, lat[(size_t)(n * 0.99)] / 1e3,
+        lat[(size_t)(n * 0.999)] / 1e3, lat[n - 1] / 1e3, per_mb
+    ); 
+}
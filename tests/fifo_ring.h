@@ -0,0 +1,167 @@
+#ifndef _FIFO_RING_H_
+#define _FIFO_RING_H_
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <poll.h>
+
+#include "ioctl_command.h"
+#include "ring.h"
+
+
+// * _ STRUCTURE DEFINITIONS ___________________________________________________
+
+/// @brief A FIFO device mapped into the process. 
+/// A mapped side replaces read() or write() on that device: each side must 
+/// only have one user at a time, mapped or not, since the cursors are moved 
+/// without any lock. 
+typedef struct fifo_map_t
+{
+    int             fd; 
+    FIFO_ring_t*    ring; 
+    unsigned char*  data; 
+    unsigned int    size; 
+    unsigned int    mask; 
+    size_t          length; 
+}   FIFO_map_t;
+
+
+// * _ FUNCTION DEFINITIONS ____________________________________________________
+
+/// @brief Map the control page and the buffer of an open FIFO device. 
+/// @param map structure filled with the mapping. 
+/// @param fd  file descriptor of the device, opened for reading and writing. 
+/// @return 0 if no error occurred, -1 otherwise. 
+static inline int fifo_map(FIFO_map_t* map, int fd)
+{
+    unsigned char*  addr; 
+    size_t          page; 
+
+    if (ioctl(fd, IO_FIFO_GET_SIZE, &(map->size)))
+        return -1; 
+
+    // The control page comes first, then the buffer rounded up to pages. 
+    page = sysconf(_SC_PAGESIZE); 
+    map->length = FIFO_MMAP_DATA_PGOFF * page + ((map->size + page - 1) & ~(page - 1)); 
+
+    addr = mmap(NULL, map->length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0); 
+    if (addr == MAP_FAILED)
+        return -1; 
+
+    map->fd = fd; 
+    map->ring = (FIFO_ring_t*)(addr + FIFO_MMAP_RING_PGOFF * page); 
+    map->data = addr + FIFO_MMAP_DATA_PGOFF * page; 
+    map->mask = map->size - 1; 
+    return 0; 
+}
+
+
+/// @brief Unmap a FIFO device mapped with fifo_map. 
+/// @param map mapping to remove. 
+static inline void fifo_unmap(FIFO_map_t* map)
+{
+    munmap(map->ring, map->length); 
+}
+
+
+/// @brief Find the contiguous free area the producer can write to. 
+/// @param map mapping of the device. 
+/// @param ptr set to the start of the area. 
+/// @return the size of the area in bytes, 0 if the FIFO is full. 
+static inline size_t fifo_ring_writable(FIFO_map_t* map, unsigned char** ptr)
+{
+    unsigned int    w_cur; 
+    unsigned int    w_pos; 
+    size_t          free_space; 
+
+    // The read cursor is only loaded when our copy of it doesn't free the 
+    // whole area up to the end of the buffer, the reader is done with every 
+    // byte up to the cursor we load. 
+    w_cur = map->ring->w_cur; 
+    w_pos = w_cur & map->mask; 
+
+    free_space = map->size - ring_write_used(map->ring, w_cur, map->size, map->size - w_pos); 
+    *ptr = map->data + w_pos; 
+
+    if (free_space > map->size - w_pos)
+        return map->size - w_pos; 
+
+    return free_space; 
+}
+
+
+/// @brief Publish bytes written in the area given by fifo_ring_writable. 
+/// @param map   mapping of the device. 
+/// @param count number of bytes written. 
+static inline void fifo_ring_produce(FIFO_map_t* map, size_t count)
+{
+    __atomic_store_n(
+        &(map->ring->w_cur), map->ring->w_cur + (unsigned int)count, __ATOMIC_RELEASE
+    ); 
+}
+
+
+/// @brief Find the contiguous area of data the consumer can read. 
+/// @param map mapping of the device. 
+/// @param ptr set to the start of the area. 
+/// @return the size of the area in bytes, 0 if the FIFO is empty. 
+static inline size_t fifo_ring_readable(FIFO_map_t* map, unsigned char** ptr)
+{
+    unsigned int    r_cur; 
+    unsigned int    r_pos; 
+    size_t          used; 
+
+    // The write cursor is only loaded when our copy of it doesn't show data 
+    // up to the end of the buffer, every byte behind the one we load is 
+    // visible. 
+    r_cur = map->ring->r_cur; 
+    r_pos = r_cur & map->mask; 
+
+    used = ring_read_used(map->ring, r_cur, map->size, map->size - r_pos); 
+    *ptr = map->data + r_pos; 
+
+    if (used > map->size - r_pos)
+        return map->size - r_pos; 
+
+    return used; 
+}
+
+
+/// @brief Release bytes read from the area given by fifo_ring_readable. 
+/// @param map   mapping of the device. 
+/// @param count number of bytes read. 
+static inline void fifo_ring_consume(FIFO_map_t* map, size_t count)
+{
+    __atomic_store_n(
+        &(map->ring->r_cur), map->ring->r_cur + (unsigned int)count, __ATOMIC_RELEASE
+    ); 
+}
+
+
+/// @brief Wake up the processes sleeping on the device after moving a 
+///        cursor. Several produce or consume calls can share one notify. 
+/// @param map mapping of the device. 
+/// @return 0 if no error occurred, -1 otherwise. 
+static inline int fifo_ring_notify(FIFO_map_t* map)
+{
+    return ioctl(map->fd, IO_FIFO_NOTIFY); 
+}
+
+
+/// @brief Sleep until the device is readable or writable. 
+/// @param map    mapping of the device. 
+/// @param events POLLIN to wait for data, POLLOUT to wait for space. 
+/// @return the poll() return value. 
+static inline int fifo_ring_wait(FIFO_map_t* map, short events)
+{
+    struct pollfd pfd; 
+
+    pfd.fd = map->fd; 
+    pfd.events = events; 
+    pfd.revents = 0; 
+    return poll(&pfd, 1, -1); 
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "fifo_ring.h"
+
+#define INTERFACE     "/dev/fifo0"
+#define RING_TOTAL    (64 * 1024 * 1024)
+#define RING_PATTERN  251
+
+// * _ FUNCTION DEFINITIONS ____________________________________________________
+void produce(FIFO_map_t* map);
+int  consume(FIFO_map_t* map);
+
+
+
+/// Exchange RING_TOTAL bytes between a producer and a consumer process through 
+/// the mapped ring of /dev/fifo0, without read() or write(). The consumer 
+/// checks every byte against the pattern written by the producer. 
+int main(void)
+{
+    FIFO_map_t  map; 
+    pid_t       pid; 
+    int         fd; 
+    int         retval; 
+
+    fd = open(INTERFACE, O_RDWR); 
+    if (fd < 0)
+    {
+        printf("Error occurred while opening %s...\n", INTERFACE); 
+        return -1; 
+    }
+
+    // Start from an empty FIFO, then share the mapping with the child. 
+    ioctl(fd, IO_FIFO_RESET); 
+    if (fifo_map(&map, fd))
+    {
+        printf("Error occurred while mapping %s...\n", INTERFACE); 
+        close(fd); 
+        return -1; 
+    }
+
+    pid = fork(); 
+    if (pid < 0)
+    {
+        fifo_unmap(&map); 
+        close(fd); 
+        return -1; 
+    }
+
+    if (!pid)
+    {
+        produce(&map); 
+        exit(0); 
+    }
+
+    retval = consume(&map); 
+    waitpid(pid, NULL, 0); 
+
+    if (retval)
+        printf("~Ring: data mismatch at byte %d.\n", retval - 1); 
+
+    else
+        printf("~Ring: %d bytes exchanged through a %u bytes buffer.\n", RING_TOTAL, map.size); 
+
+    fifo_unmap(&map); 
+    close(fd); 
+    return retval ? -1 : 0; 
+}
+
+
+void produce(FIFO_map_t* map)
+{
+    unsigned char*  ptr; 
+    size_t          len; 
+    size_t          i; 
+    int             offset; 
+
+    offset = 0; 
+    while (offset < RING_TOTAL)
+    {
+        // Sleep in poll() while the buffer is full, the consumer notifies us 
+        // once it released some space. 
+        len = fifo_ring_writable(map, &ptr); 
+        if (!len)
+        {
+            fifo_ring_wait(map, POLLOUT); 
+            continue; 
+        }
+
+        if (len > (size_t)(RING_TOTAL - offset))
+            len = RING_TOTAL - offset; 
+
+        for (i = 0; i < len; i += 1)
+            ptr[i] = (offset + i) % RING_PATTERN; 
+
+        fifo_ring_produce(map, len); 
+        fifo_ring_notify(map); 
+        offset += len; 
+    }
+}
+
+
+int consume(FIFO_map_t* map)
+{
+    unsigned char*  ptr; 
+    size_t          len; 
+    size_t          i; 
+    int             offset; 
+
+    offset = 0; 
+    while (offset < RING_TOTAL)
+    {
+        len = fifo_ring_readable(map, &ptr); 
+        if (!len)
+        {
+            fifo_ring_wait(map, POLLIN); 
+            continue; 
+        }
+
+        // Return the offset of the first wrong byte, plus one. 
+        for (i = 0; i < len; i += 1)
+        {
+            if (ptr[i] != (offset + i) % RING_PATTERN)
+                return offset + i + 1; 
+        }
+
+        fifo_ring_consume(map, len); 
+        fifo_ring_notify(map); 
+        offset += len; 
+    }
+
+    return 0; 
+}
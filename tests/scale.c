@@ -0,0 +1,315 @@
+#define _GNU_SOURCE
+#include <sys/ioctl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include "ioctl_command.h"
+
+// * _ SCALE SETTINGS __________________________________________________________
+#define SCALE_DEVICE        "/dev/fifo0"
+#define SCALE_MAX_MSG       4096
+#define SCALE_POLL_MS       10
+
+// Defaults of the command line options. 
+#define SCALE_SECONDS       2
+#define SCALE_MSG_SIZE      64
+
+// * _ STRUCTURE DEFINITIONS ___________________________________________________
+
+/// @brief A producer thread, pinned to cpu. sent counts the messages it wrote. 
+typedef struct scale_thread_t
+{
+    pthread_t           thread; 
+    unsigned int        cpu; 
+    uint64_t            sent; 
+    int                 error; 
+}   SCALE_thread_t; 
+
+
+// * _ FUNCTION DEFINITIONS ____________________________________________________
+int         set_mode(int mode); 
+double      run(int mode, unsigned int producers, bool* failed); 
+void*       producer(void* arg); 
+
+// * _ GLOBAL VARIABLES ________________________________________________________
+static const char*          device = SCALE_DEVICE; 
+static unsigned int         seconds = SCALE_SECONDS; 
+static unsigned int         msg_size = SCALE_MSG_SIZE; 
+static unsigned int         cpus; 
+static bool                 stop_producers; 
+static unsigned int         done_producers; 
+
+
+
+/// Compare the aggregate throughput of many producers writing to one device, 
+/// in record mode where they share the write side and in sharded mode where 
+/// each CPU has its own ring, with a single consumer draining the device. 
+/// Usage: scale [-t seconds per run] [-s message size] [device]. 
+int main(int argc, char** argv)
+{
+    unsigned int    producers; 
+    unsigned int    size; 
+    double          record; 
+    double          sharded; 
+    bool            failed; 
+    int             old_mode; 
+    int             opt; 
+    int             fd; 
+
+    while ((opt = getopt(argc, argv, "t:s:")) != -1)
+    {
+        if (opt == 't')
+            seconds = atoi(optarg); 
+
+        else if (opt == 's')
+            msg_size = atoi(optarg); 
+
+        else
+        {
+            printf("Usage: %s [-t seconds per run] [-s message size] [device]\n", argv[0]); 
+            return -1; 
+        }
+    }
+
+    if (optind < argc)
+        device = argv[optind]; 
+
+    fd = open(device, O_RDWR); 
+    if (fd < 0)
+    {
+        perror("~Can't open the device"); 
+        return -1; 
+    }
+
+    if (ioctl(fd, IO_FIFO_GET_SIZE, &size) || ioctl(fd, IO_FIFO_GET_MODE, &old_mode))
+    {
+        perror("~Can't read the device settings"); 
+        close(fd); 
+        return -1; 
+    }
+
+    close(fd); 
+
+    // A message and its header must fit a few times in each ring. 
+    if (!msg_size || msg_size > SCALE_MAX_MSG || msg_size > size / 4)
+    {
+        printf("~Messages of 1 to %u bytes fit in a %u bytes buffer.\n", size / 4 < SCALE_MAX_MSG ? size / 4 : SCALE_MAX_MSG, size); 
+        return -1; 
+    }
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN); 
+    printf(
+        "~%s: %u bytes buffer, messages of %u bytes, %u s per run, %u CPU(s).\n", 
+        device, size, msg_size, seconds, cpus
+    ); 
+
+    // Double the producers up to one per CPU, then one per CPU exactly. 
+    failed = false; 
+    printf("%10s %14s %14s %8s\n", "producers", "record msg/s", "sharded msg/s", "ratio"); 
+    for (producers = 1; !failed; producers *= 2)
+    {
+        if (producers > cpus)
+            producers = cpus; 
+
+        record = run(FIFO_MODE_RECORD, producers, &failed); 
+        sharded = run(FIFO_MODE_RECORD | FIFO_MODE_SHARDED, producers, &failed); 
+        printf("%10u %14.0f %14.0f %7.2fx\n", producers, record, sharded, record ? sharded / record : 0); 
+
+        if (producers == cpus)
+            break; 
+    }
+
+    set_mode(old_mode); 
+    return failed ? -1 : 0; 
+}
+
+
+/// Empty the device and switch it to a mode. 
+int set_mode(int mode)
+{
+    int fd; 
+
+    fd = open(device, O_RDWR); 
+    if (fd < 0)
+        return -1; 
+
+    ioctl(fd, IO_FIFO_RESET); 
+    if (ioctl(fd, IO_FIFO_SET_MODE, &mode))
+    {
+        perror("~Mode change failed"); 
+        close(fd); 
+        return -1; 
+    }
+
+    close(fd); 
+    return 0; 
+}
+
+
+/// Run producers pinned one per CPU for the run duration while this thread 
+/// consumes, then drain what they left. Returns the messages per second 
+/// received, and sets failed if a message was lost or an error occurred. 
+double run(int mode, unsigned int producers, bool* failed)
+{
+    SCALE_thread_t*     threads; 
+    struct timespec     start; 
+    struct timespec     now; 
+    struct pollfd       pfd; 
+    unsigned char       buf[SCALE_MAX_MSG]; 
+    uint64_t            received; 
+    uint64_t            sent; 
+    double              elapsed; 
+    unsigned int        i; 
+    bool                stopped; 
+    bool                drained; 
+    ssize_t             len; 
+
+    if (set_mode(mode))
+    {
+        *failed = true; 
+        return 0; 
+    }
+
+    // A non-blocking consumer, so it notices the end of the run even while 
+    // the device is empty. 
+    pfd.fd = open(device, O_RDONLY | O_NONBLOCK); 
+    pfd.events = POLLIN; 
+    threads = (SCALE_thread_t*)calloc(producers, sizeof(SCALE_thread_t)); 
+    if (pfd.fd < 0 || !threads)
+    {
+        *failed = true; 
+        return 0; 
+    }
+
+    __atomic_store_n(&stop_producers, false, __ATOMIC_RELAXED); 
+    __atomic_store_n(&done_producers, 0, __ATOMIC_RELAXED); 
+    for (i = 0; i < producers; i += 1)
+    {
+        threads[i].cpu = i % cpus; 
+        if (pthread_create(&(threads[i].thread), NULL, producer, &(threads[i])))
+        {
+            printf("~Can't start the producer threads.\n"); 
+            exit(-1); 
+        }
+    }
+
+    // Stop the producers once the run is over, then read until they are all 
+    // gone and the device is empty. They may be waiting for room until then. 
+    clock_gettime(CLOCK_MONOTONIC, &start); 
+    received = 0; 
+    stopped = false; 
+    drained = false; 
+    elapsed = 0; 
+    while (true)
+    {
+        len = read(pfd.fd, buf, sizeof(buf)); 
+        if (len >= 0)
+        {
+            received += 1; 
+            continue; 
+        }
+
+        if (errno != EAGAIN)
+        {
+            perror("~Read failed"); 
+            *failed = true; 
+            break; 
+        }
+
+        if (drained)
+            break; 
+
+        // Once every producer is gone, every message it sent is in the 
+        // device: the acquire pairs with their release after the last write. 
+        // Read until empty once more, the last one may have come since. 
+        if (stopped && __atomic_load_n(&done_producers, __ATOMIC_ACQUIRE) == producers)
+        {
+            drained = true; 
+            continue; 
+        }
+
+        if (!stopped)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now); 
+            elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9; 
+            stopped = elapsed >= seconds; 
+            __atomic_store_n(&stop_producers, stopped, __ATOMIC_RELAXED); 
+        }
+
+        poll(&pfd, 1, SCALE_POLL_MS); 
+    }
+
+    for (i = 0; i < producers; i += 1)
+        pthread_join(threads[i].thread, NULL); 
+
+    sent = 0; 
+    for (i = 0; i < producers; i += 1)
+    {
+        sent += threads[i].sent; 
+        if (threads[i].error)
+        {
+            printf("~Write failed on CPU %u: %s.\n", threads[i].cpu, strerror(threads[i].error)); 
+            *failed = true; 
+        }
+    }
+
+    if (!*failed && sent != received)
+    {
+        printf("~%llu message(s) sent, %llu received.\n", (unsigned long long)sent, (unsigned long long)received); 
+        *failed = true; 
+    }
+
+    close(pfd.fd); 
+    free(threads); 
+    return elapsed ? received / elapsed : 0; 
+}
+
+
+/// Pin to a CPU and write messages until told to stop. Writes block while 
+/// the ring is full. 
+void* producer(void* arg)
+{
+    SCALE_thread_t*     self; 
+    cpu_set_t           set; 
+    unsigned char       buf[SCALE_MAX_MSG]; 
+    int                 fd; 
+
+    self = arg; 
+    CPU_ZERO(&set); 
+    CPU_SET(self->cpu, &set); 
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set); 
+
+    fd = open(device, O_WRONLY); 
+    if (fd < 0)
+    {
+        self->error = errno; 
+        __atomic_add_fetch(&done_producers, 1, __ATOMIC_RELEASE); 
+        return NULL; 
+    }
+
+    memset(buf, self->cpu, msg_size); 
+    while (!__atomic_load_n(&stop_producers, __ATOMIC_RELAXED))
+    {
+        if (write(fd, buf, msg_size) != (ssize_t)msg_size)
+        {
+            self->error = errno; 
+            break; 
+        }
+
+        self->sent += 1; 
+    }
+
+    close(fd); 
+    __atomic_add_fetch(&done_producers, 1, __ATOMIC_RELEASE); 
+    return NULL; 
+}
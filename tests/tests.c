@@ -1,27 +1,73 @@
+#define _GNU_SOURCE
+
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include "ioctl_command.h"
 
 #define INTERFACE "/dev/fifo0"
+#define CONTROL   "/dev/fifo_ctl"
+#define SPSC_PARAM "/sys/module/fifo/parameters/spsc_enabled"
 
 // * _ COMMANDS ________________________________________________________________
 #define CMD_READ    "read"
 #define CMD_WRITE   "write"
+#define CMD_WRITEV  "writev"
+#define CMD_SPLICE  "splice"
 #define CMD_SET     "ioctl"
+#define CMD_BENCH   "bench"
+#define CMD_STRESS  "stress"
+#define CMD_BATCH   "batch"
+#define CMD_RESIZE  "resize"
+#define CMD_MARKS   "watermarks"
+#define CMD_LAG     "lag"
+#define CMD_NODE    "node"
+#define CMD_CREATE  "create"
+#define CMD_DESTROY "destroy"
 
 // * _ SET COMMANDS ____________________________________________________________
 #define RESET           "reset"
 #define GET_READ_CUR    "cursor"
+#define GET_SIZE        "size"
+#define SET_RECORD      "record"
+#define SET_STREAM      "stream"
+#define SET_OVERWRITE   "overwrite"
+#define SET_BROADCAST   "broadcast"
+#define SET_SHARDED     "sharded"
+#define SET_ORDERED     "ordered"
+#define GET_NEXT_SIZE   "next"
+#define RESET_STATS     "stats"
+
+// * _ BENCHMARK SETTINGS ______________________________________________________
+#define BENCH_TOTAL     (64 * 1024 * 1024)
+#define STRESS_PATTERN  251
+#define BATCH_MSGS      (1024 * 1024)
+#define BATCH_SIZE      64
 
 // * _ FUNCTION DEFINITIONS ____________________________________________________
 void test_read(int fd, char* str);
 void test_write(int fd, char* str);
+void test_writev(int fd, char* str);
+void test_splice(int fd, char* str);
 void test_set(int fd, char* str);
+void test_resize(int fd, char* str);
+void test_watermarks(int fd, char* str);
+void test_lag(int fd, char* str);
+void test_node(int fd, char* str);
+void test_control(char* cmd, char* str);
+void test_bench(int fd, char* str);
+void test_stress(char* str);
+int  stress_run(int chunk, double* elapsed);
+int  set_spsc(char mode);
+void test_batch(int fd, char* str);
+int  batch_run(int fd, int size, int batched, double* elapsed, long* calls);
 void usage(char* bin_name); 
 
 
@@ -36,6 +82,13 @@ int main(int argc, char** argv)
         return -1; 
     }
 
+    // Device creation and destruction go through the control device. 
+    if (!strcmp(argv[1], CMD_CREATE) || !strcmp(argv[1], CMD_DESTROY))
+    {
+        test_control(argv[1], argv[2]); 
+        return 0; 
+    }
+
     fd = open(INTERFACE, O_RDWR);
     if (fd < 0)
     {
@@ -58,8 +111,35 @@ int main(int argc, char** argv)
     else if (!strcmp(argv[1], CMD_WRITE))
         test_write(fd, argv[2]); 
 
+    else if (!strcmp(argv[1], CMD_WRITEV))
+        test_writev(fd, argv[2]); 
+
+    else if (!strcmp(argv[1], CMD_SPLICE))
+        test_splice(fd, argv[2]); 
+
     else if (!strcmp(argv[1], CMD_SET))
         test_set(fd, argv[2]);
+
+    else if (!strcmp(argv[1], CMD_RESIZE))
+        test_resize(fd, argv[2]);
+
+    else if (!strcmp(argv[1], CMD_MARKS))
+        test_watermarks(fd, argv[2]);
+
+    else if (!strcmp(argv[1], CMD_LAG))
+        test_lag(fd, argv[2]);
+
+    else if (!strcmp(argv[1], CMD_NODE))
+        test_node(fd, argv[2]);
+
+    else if (!strcmp(argv[1], CMD_BENCH))
+        test_bench(fd, argv[2]);
+
+    else if (!strcmp(argv[1], CMD_STRESS))
+        test_stress(argv[2]);
+
+    else if (!strcmp(argv[1], CMD_BATCH))
+        test_batch(fd, argv[2]);
     
     else 
         usage(argv[0]); 
@@ -107,10 +187,69 @@ void test_write(int fd, char* str)
 }
 
 
+void test_writev(int fd, char* str)
+{
+    struct iovec    iov[2]; 
+    char            header[16]; 
+    ssize_t         retval; 
+
+    // Prefix the message with its length, both pieces go in a single call. 
+    iov[0].iov_base = header; 
+    iov[0].iov_len = snprintf(header, sizeof(header), "[%zu]", strlen(str)); 
+    iov[1].iov_base = str; 
+    iov[1].iov_len = strlen(str); 
+
+    retval = writev(fd, iov, 2); 
+    printf("~Wrote bytes (%zd): %s%s\n", retval, header, str); 
+    return; 
+}
+
+
+void test_splice(int fd, char* str)
+{
+    int     pipefd[2]; 
+    int     count; 
+    ssize_t moved; 
+    ssize_t retval; 
+
+    count = atoi(str); 
+    if (count < 1)
+        return; 
+
+    if (pipe(pipefd))
+        return; 
+
+    // Move the bytes from the device to the standard output through a pipe, 
+    // without going through a user-space buffer. The standard output must be 
+    // a file, a pipe or a socket. 
+    moved = 0; 
+    while (moved < count)
+    {
+        retval = splice(fd, NULL, pipefd[1], NULL, count - moved, SPLICE_F_MOVE); 
+        if (retval <= 0)
+            break; 
+
+        retval = splice(pipefd[0], NULL, STDOUT_FILENO, NULL, retval, SPLICE_F_MOVE); 
+        if (retval <= 0)
+            break; 
+
+        moved += retval; 
+    }
+
+    // The standard output holds the data, report on the error output. 
+    fprintf(stderr, "~Spliced bytes (%zd).\n", moved); 
+    close(pipefd[0]); 
+    close(pipefd[1]); 
+    return; 
+}
+
+
 void test_set(int fd, char* str)
 {
-    int r_cur; 
-    int w_cur;
+    int             r_cur; 
+    int             w_cur;
+    int             mode; 
+    unsigned int    size; 
     
 
     if (!strcmp(str, RESET))
@@ -126,13 +265,498 @@ void test_set(int fd, char* str)
         printf("~Cursor positions: r:%d | w:%d.\n", r_cur, w_cur); 
     }
 
+    else if (!strcmp(str, GET_SIZE))
+    {
+        ioctl(fd, IO_FIFO_GET_SIZE, &size); 
+        printf("~Buffer size: %u bytes.\n", size); 
+    }
+
+    else if (!strcmp(str, SET_RECORD) || !strcmp(str, SET_STREAM) || 
+             !strcmp(str, SET_OVERWRITE) || !strcmp(str, SET_BROADCAST) || 
+             !strcmp(str, SET_SHARDED) || !strcmp(str, SET_ORDERED))
+    {
+        mode = FIFO_MODE_STREAM; 
+        if (!strcmp(str, SET_RECORD))
+            mode = FIFO_MODE_RECORD; 
+
+        else if (!strcmp(str, SET_OVERWRITE))
+            mode = FIFO_MODE_OVERWRITE; 
+
+        else if (!strcmp(str, SET_BROADCAST))
+            mode = FIFO_MODE_BROADCAST; 
+
+        // Sharded devices only hold messages. 
+        else if (!strcmp(str, SET_SHARDED))
+            mode = FIFO_MODE_RECORD | FIFO_MODE_SHARDED; 
+
+        else if (!strcmp(str, SET_ORDERED))
+            mode = FIFO_MODE_RECORD | FIFO_MODE_SHARDED | FIFO_MODE_ORDERED; 
+
+        if (ioctl(fd, IO_FIFO_SET_MODE, &mode))
+            perror("~Mode change failed"); 
+
+        else 
+            printf("~FIFO in %s mode.\n", str); 
+    }
+
+    else if (!strcmp(str, RESET_STATS))
+    {
+        ioctl(fd, IO_FIFO_RESET_STATS); 
+        printf("~FIFO statistics reset.\n"); 
+    }
+
+    else if (!strcmp(str, GET_NEXT_SIZE))
+    {
+        ioctl(fd, IO_FIFO_NEXT_SIZE, &size); 
+        printf("~Next read size: %u bytes.\n", size); 
+    }
+
     return; 
 }
 
 
+void test_resize(int fd, char* str)
+{
+    unsigned int size; 
+
+    size = atoi(str); 
+    if (ioctl(fd, IO_FIFO_SET_SIZE, &size))
+    {
+        perror("~FIFO resize failed"); 
+        return; 
+    }
+
+    printf("~Buffer size: %u bytes.\n", size); 
+    return; 
+}
+
+
+/// Set the watermarks given as <low>:<high>, in bytes of used space, then print 
+/// the ones in use. Any other argument only prints them. 
+void test_watermarks(int fd, char* str)
+{
+    FIFO_watermarks_t marks; 
+
+    if (sscanf(str, "%u:%u", &(marks.low), &(marks.high)) == 2 && 
+        ioctl(fd, IO_FIFO_SET_WATERMARKS, &marks))
+    {
+        perror("~Watermarks change failed"); 
+        return; 
+    }
+
+    ioctl(fd, IO_FIFO_GET_WATERMARKS, &marks); 
+    printf("~Watermarks: low %u | high %u bytes.\n", marks.low, marks.high); 
+    return; 
+}
+
+
+void test_lag(int fd, char* str)
+{
+    unsigned int max_lag; 
+
+    if (sscanf(str, "%u", &max_lag) == 1 && ioctl(fd, IO_FIFO_SET_MAX_LAG, &max_lag))
+    {
+        perror("~Lag limit change failed"); 
+        return; 
+    }
+
+    ioctl(fd, IO_FIFO_GET_MAX_LAG, &max_lag); 
+    printf("~Broadcast readers dropped past %u bytes behind (0: never).\n", max_lag); 
+    return; 
+}
+
+
+void test_node(int fd, char* str)
+{
+    int node; 
+
+    if (sscanf(str, "%d", &node) == 1 && ioctl(fd, IO_FIFO_SET_NODE, &node))
+    {
+        perror("~Node change failed"); 
+        return; 
+    }
+
+    ioctl(fd, IO_FIFO_GET_NODE, &node); 
+    printf("~Buffer allocated on node %d (-1: any).\n", node); 
+    return; 
+}
+
+
+void test_control(char* cmd, char* str)
+{
+    int fd; 
+    int minor; 
+
+    fd = open(CONTROL, O_RDWR); 
+    if (fd < 0)
+    {
+        printf("Error occurred while opening %s...\n", CONTROL); 
+        return; 
+    }
+
+    minor = atoi(str); 
+
+    if (!strcmp(cmd, CMD_CREATE))
+    {
+        if (ioctl(fd, IO_FIFO_CTL_CREATE, &minor))
+            perror("~FIFO creation failed"); 
+
+        else
+            printf("~Created /dev/fifo%d.\n", minor); 
+    }
+
+    else if (ioctl(fd, IO_FIFO_CTL_DESTROY, &minor))
+        perror("~FIFO destruction failed"); 
+
+    else
+        printf("~Destroyed /dev/fifo%d.\n", minor); 
+
+    close(fd); 
+    return; 
+}
+
+
+void test_bench(int fd, char* str)
+{
+    struct timespec start; 
+    struct timespec end; 
+    double          elapsed; 
+    int             chunk; 
+    size_t          done; 
+    size_t          len; 
+    ssize_t         retval; 
+    pid_t           pid; 
+    char*           buf; 
+
+    chunk = atoi(str); 
+    if (chunk < 1)
+        return; 
+
+    buf = (char*)malloc(sizeof(char) * chunk); 
+    if (!buf)
+        return; 
+
+    memset(buf, 'a', chunk); 
+    ioctl(fd, IO_FIFO_RESET); 
+    clock_gettime(CLOCK_MONOTONIC, &start); 
+
+    // The child drains the FIFO while the parent fills it, both using chunks 
+    // of the requested size. 
+    pid = fork(); 
+    if (pid < 0)
+    {
+        free(buf); 
+        return; 
+    }
+
+    done = 0; 
+    while (done < BENCH_TOTAL)
+    {
+        len = BENCH_TOTAL - done < (size_t)chunk ? BENCH_TOTAL - done : (size_t)chunk; 
+
+        if (pid == 0)
+            retval = read(fd, buf, len); 
+
+        else
+            retval = write(fd, buf, len); 
+
+        if (retval < 0)
+            break; 
+
+        done += retval; 
+    }
+
+    if (pid == 0)
+    {
+        free(buf); 
+        exit(0); 
+    }
+
+    waitpid(pid, NULL, 0); 
+    clock_gettime(CLOCK_MONOTONIC, &end); 
+
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9; 
+    printf(
+        "~Transferred %zu bytes in chunks of %d in %.3fs: %.1f MB/s.\n", 
+        done, chunk, elapsed, done / elapsed / 1e6
+    ); 
+
+    free(buf); 
+    return; 
+}
+
+
+void test_stress(char* str)
+{
+    const char  modes[] = { '1', '0' }; 
+    double      elapsed; 
+    int         chunk; 
+    int         errors; 
+    int         i; 
+
+    chunk = atoi(str); 
+    if (chunk < 1)
+        return; 
+
+    // Run the same transfer with the lockless path and with the mutexes. When 
+    // the module parameter can't be changed, only run the current mode. 
+    for (i = 0; i < 2; i += 1)
+    {
+        if (set_spsc(modes[i]))
+        {
+            printf("~Can't write %s, running the current mode only.\n", SPSC_PARAM); 
+            i = 2; 
+        }
+
+        errors = stress_run(chunk, &elapsed); 
+        if (errors < 0)
+        {
+            printf("~Error occurred while opening %s...\n", INTERFACE); 
+            break; 
+        }
+
+        printf(
+            "~%s path: %d MB in chunks of %d in %.3fs: %.1f MB/s, %d corrupted byte(s).\n", 
+            i == 2 ? "Current" : (modes[i] == '1' ? "SPSC" : "Mutex"), 
+            BENCH_TOTAL / (1024 * 1024), chunk, elapsed, BENCH_TOTAL / elapsed / 1e6, errors
+        ); 
+    }
+
+    set_spsc('1'); 
+    return; 
+}
+
+
+int stress_run(int chunk, double* elapsed)
+{
+    struct timespec start; 
+    struct timespec end; 
+    unsigned char*  buf; 
+    size_t          done; 
+    size_t          len; 
+    size_t          i; 
+    ssize_t         retval; 
+    int             status; 
+    int             errors; 
+    int             fd; 
+    pid_t           pid; 
+
+    buf = (unsigned char*)malloc(sizeof(char) * chunk); 
+    if (!buf)
+        return -1; 
+
+    // Start from an empty FIFO. 
+    fd = open(INTERFACE, O_RDWR); 
+    if (fd < 0)
+    {
+        free(buf); 
+        return -1; 
+    }
+
+    ioctl(fd, IO_FIFO_RESET); 
+    close(fd); 
+
+    clock_gettime(CLOCK_MONOTONIC, &start); 
+
+    // The child is the only reader and the parent the only writer, each with 
+    // its own file description. Every byte carries its offset in the stream so 
+    // the reader can check it got what was written, in order. 
+    pid = fork(); 
+    if (pid < 0)
+    {
+        free(buf); 
+        return -1; 
+    }
+
+    fd = open(INTERFACE, pid == 0 ? O_RDONLY : O_WRONLY); 
+    if (fd < 0)
+    {
+        if (pid == 0)
+            exit(255); 
+
+        waitpid(pid, NULL, 0); 
+        free(buf); 
+        return -1; 
+    }
+
+    errors = 0; 
+    done = 0; 
+    while (done < BENCH_TOTAL)
+    {
+        len = BENCH_TOTAL - done < (size_t)chunk ? BENCH_TOTAL - done : (size_t)chunk; 
+
+        if (pid == 0)
+        {
+            retval = read(fd, buf, len); 
+            for (i = 0; retval > 0 && i < (size_t)retval; i += 1)
+                errors += buf[i] != (unsigned char)((done + i) % STRESS_PATTERN); 
+        }
+
+        else
+        {
+            for (i = 0; i < len; i += 1)
+                buf[i] = (unsigned char)((done + i) % STRESS_PATTERN); 
+
+            retval = write(fd, buf, len); 
+        }
+
+        if (retval < 0)
+            break; 
+
+        done += retval; 
+    }
+
+    close(fd); 
+    free(buf); 
+
+    // The child reports the number of corrupted bytes through its exit status. 
+    if (pid == 0)
+        exit(errors > 254 ? 254 : errors); 
+
+    waitpid(pid, &status, 0); 
+    clock_gettime(CLOCK_MONOTONIC, &end); 
+
+    *elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9; 
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 255)
+        return -1; 
+
+    return WEXITSTATUS(status); 
+}
+
+
+int set_spsc(char mode)
+{
+    int fd; 
+    int retval; 
+
+    fd = open(SPSC_PARAM, O_WRONLY); 
+    if (fd < 0)
+        return -1; 
+
+    retval = write(fd, &mode, 1); 
+    close(fd); 
+    return retval == 1 ? 0 : -1; 
+}
+
+
 // * _ UTILITIES _______________________________________________________________
 
 
+void test_batch(int fd, char* str)
+{
+    const char* names[] = { "Single", "Batch" }; 
+    double      elapsed; 
+    long        calls; 
+    int         size; 
+    int         mode; 
+    int         i; 
+
+    size = atoi(str); 
+    if (size < 1)
+        return; 
+
+    // Both runs move the same messages through a record mode FIFO, one per 
+    // system call and then BATCH_SIZE per system call. 
+    ioctl(fd, IO_FIFO_RESET); 
+    mode = FIFO_MODE_RECORD; 
+    if (ioctl(fd, IO_FIFO_SET_MODE, &mode))
+    {
+        perror("~Record mode unavailable"); 
+        return; 
+    }
+
+    for (i = 0; i < 2; i += 1)
+    {
+        if (batch_run(fd, size, i, &elapsed, &calls))
+        {
+            printf("~%s: run failed.\n", names[i]); 
+            break; 
+        }
+
+        printf(
+            "~%s: %d messages of %d bytes in %.3fs: %.0f msg/s, %ld write calls.\n", 
+            names[i], BATCH_MSGS, size, elapsed, BATCH_MSGS / elapsed, calls
+        ); 
+    }
+
+    ioctl(fd, IO_FIFO_RESET); 
+    mode = FIFO_MODE_STREAM; 
+    ioctl(fd, IO_FIFO_SET_MODE, &mode); 
+    return; 
+}
+
+
+int batch_run(int fd, int size, int batched, double* elapsed, long* calls)
+{
+    struct timespec start; 
+    struct timespec end; 
+    FIFO_msg_t      msgs[BATCH_SIZE]; 
+    FIFO_batch_t    batch; 
+    char*           buf; 
+    long            done; 
+    long            retval; 
+    pid_t           pid; 
+    int             status; 
+    int             i; 
+
+    buf = (char*)malloc(sizeof(char) * size * BATCH_SIZE); 
+    if (!buf)
+        return -1; 
+
+    memset(buf, 'a', size * BATCH_SIZE); 
+    for (i = 0; i < BATCH_SIZE; i += 1)
+    {
+        msgs[i].buf = (unsigned long long)(unsigned long)(buf + i * size); 
+        msgs[i].pad = 0; 
+    }
+
+    batch.msgs = (unsigned long long)(unsigned long)msgs; 
+    batch.pad = 0; 
+    clock_gettime(CLOCK_MONOTONIC, &start); 
+
+    // The child reads while the parent writes, the same way. 
+    pid = fork(); 
+    if (pid < 0)
+    {
+        free(buf); 
+        return -1; 
+    }
+
+    *calls = 0; 
+    done = 0; 
+    while (done < BATCH_MSGS)
+    {
+        batch.count = BATCH_MSGS - done < BATCH_SIZE ? BATCH_MSGS - done : BATCH_SIZE; 
+        for (i = 0; i < BATCH_SIZE; i += 1)
+            msgs[i].len = size; 
+
+        if (!batched)
+            retval = pid == 0 ? read(fd, buf, size) : write(fd, buf, size); 
+
+        else 
+            retval = ioctl(fd, pid == 0 ? IO_FIFO_READ_BATCH : IO_FIFO_WRITE_BATCH, &batch); 
+
+        if (retval < 0)
+            break; 
+
+        // A plain read or write moves a single message. 
+        done += batched ? retval : 1; 
+        *calls += 1; 
+    }
+
+    free(buf); 
+    if (pid == 0)
+        exit(done < BATCH_MSGS); 
+
+    waitpid(pid, &status, 0); 
+    clock_gettime(CLOCK_MONOTONIC, &end); 
+
+    *elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9; 
+    return done < BATCH_MSGS || !WIFEXITED(status) || WEXITSTATUS(status); 
+}
+
+
 void usage(char* bin_name)
 {
     printf("USAGE: \n\t %s [command] [arg]\n", bin_name); 
@@ -0,0 +1,536 @@
+#define _GNU_SOURCE
+#include <sys/ioctl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+#include "ioctl_command.h"
+
+// * _ TORTURE SETTINGS ________________________________________________________
+#define TORTURE_DEVICES     1024
+#define TORTURE_MAX_MSG     1024
+#define TORTURE_MAGIC       0x46494630
+#define TORTURE_POLL_MS     10
+#define TORTURE_REPORTS     10
+
+// Defaults of the command line options. 
+#define TORTURE_WRITERS     2
+#define TORTURE_READERS     2
+#define TORTURE_SECONDS     10
+#define TORTURE_RESET_MS    100
+
+// * _ STRUCTURE DEFINITIONS ___________________________________________________
+
+/// @brief Header of every message. seq counts the messages of a writer from 
+/// 1, sum is the FNV-1a hash of the header, sum excluded, and of the payload. 
+typedef struct torture_msg_t
+{
+    uint32_t            magic; 
+    uint32_t            writer; 
+    uint64_t            seq; 
+    uint32_t            len; 
+    uint32_t            sum; 
+}   TORTURE_msg_t; 
+
+
+/// @brief A device under test, with the settings to give back once done. 
+/// Its writers have the global ids first_writer to first_writer + writers. 
+typedef struct torture_device_t
+{
+    char                path[32]; 
+    unsigned int        old_size; 
+    int                 old_mode; 
+    unsigned int        max_msg; 
+    unsigned int        first_writer; 
+}   TORTURE_device_t; 
+
+
+/// @brief A writer or reader thread. A reader keeps the last sequence 
+/// number it received from each writer of its device in last_seq. 
+typedef struct torture_thread_t
+{
+    pthread_t           thread; 
+    TORTURE_device_t*   device; 
+    unsigned int        id; 
+    uint64_t*           last_seq; 
+}   TORTURE_thread_t; 
+
+
+/// @brief Counters shared by every thread, updated atomically. sent and 
+/// received are per writer, to check nothing was lost without resets. 
+typedef struct torture_stats_t
+{
+    uint64_t            msgs; 
+    uint64_t            bytes; 
+    uint64_t            resets; 
+    uint64_t            errors; 
+    uint64_t*           sent; 
+    uint64_t*           received; 
+}   TORTURE_stats_t; 
+
+
+// * _ FUNCTION DEFINITIONS ____________________________________________________
+uint32_t    checksum(const TORTURE_msg_t* msg, const unsigned char* payload); 
+uint32_t    next_random(uint32_t* state); 
+void        report_error(const TORTURE_device_t* device, const char* reason, long long value); 
+int         setup_device(TORTURE_device_t* device); 
+void        restore_device(TORTURE_device_t* device); 
+void*       writer(void* arg); 
+void*       reader(void* arg); 
+void*       resetter(void* arg); 
+
+// * _ GLOBAL VARIABLES ________________________________________________________
+static TORTURE_device_t*    devices; 
+static unsigned int         dev_count; 
+static unsigned int         writers = TORTURE_WRITERS; 
+static unsigned int         readers = TORTURE_READERS; 
+static unsigned int         reset_ms = TORTURE_RESET_MS; 
+static TORTURE_stats_t      stats; 
+static bool                 stop_writers; 
+static bool                 stop_readers; 
+
+
+
+/// Run writers, readers and resets against every FIFO device at once, check 
+/// every message received and print the throughput every second. 
+/// Usage: torture [-w writers] [-r readers] [-t seconds] [-x reset period 
+/// in ms, 0 for none]. 
+int main(int argc, char** argv)
+{
+    TORTURE_thread_t*   w_threads; 
+    TORTURE_thread_t*   r_threads; 
+    pthread_t           reset_thread; 
+    struct timespec     start; 
+    struct timespec     now; 
+    TORTURE_device_t    device; 
+    uint64_t            last_msgs; 
+    uint64_t            last_bytes; 
+    uint64_t            msgs; 
+    uint64_t            bytes; 
+    unsigned int        seconds; 
+    unsigned int        elapsed; 
+    unsigned int        d; 
+    unsigned int        i; 
+    int                 opt; 
+
+    seconds = TORTURE_SECONDS; 
+    while ((opt = getopt(argc, argv, "w:r:t:x:")) != -1)
+    {
+        if (opt == 'w')
+            writers = atoi(optarg); 
+
+        else if (opt == 'r')
+            readers = atoi(optarg); 
+
+        else if (opt == 't')
+            seconds = atoi(optarg); 
+
+        else if (opt == 'x')
+            reset_ms = atoi(optarg); 
+
+        else
+        {
+            printf("Usage: %s [-w writers] [-r readers] [-t seconds] [-x reset period in ms]\n", argv[0]); 
+            return -1; 
+        }
+    }
+
+    if (!writers || !readers)
+    {
+        printf("~At least one writer and one reader per device are needed.\n"); 
+        return -1; 
+    }
+
+    // Every minor in use gets its writers and readers, the gaps left by 
+    // destroyed devices are skipped. 
+    devices = (TORTURE_device_t*)calloc(TORTURE_DEVICES, sizeof(TORTURE_device_t)); 
+    if (!devices)
+        return -1; 
+
+    dev_count = 0; 
+    for (d = 0; d < TORTURE_DEVICES; d += 1)
+    {
+        memset(&device, 0, sizeof(TORTURE_device_t)); 
+        snprintf(device.path, sizeof(device.path), "/dev/fifo%u", d); 
+        if (access(device.path, F_OK))
+            continue; 
+
+        device.first_writer = dev_count * writers; 
+        if (setup_device(&device))
+        {
+            printf("~Can't set %s up, skipped.\n", device.path); 
+            continue; 
+        }
+
+        devices[dev_count] = device; 
+        dev_count += 1; 
+    }
+
+    if (!dev_count)
+    {
+        printf("~No FIFO device found.\n"); 
+        free(devices); 
+        return -1; 
+    }
+
+    stats.sent = (uint64_t*)calloc(dev_count * writers, sizeof(uint64_t)); 
+    stats.received = (uint64_t*)calloc(dev_count * writers, sizeof(uint64_t)); 
+    w_threads = (TORTURE_thread_t*)calloc(dev_count * writers, sizeof(TORTURE_thread_t)); 
+    r_threads = (TORTURE_thread_t*)calloc(dev_count * readers, sizeof(TORTURE_thread_t)); 
+    if (!stats.sent || !stats.received || !w_threads || !r_threads)
+        return -1; 
+
+    printf(
+        "~%u device(s), %u writer(s) and %u reader(s) each, reset every %u ms, for %u s.\n",
+        dev_count, writers, readers, reset_ms, seconds
+    ); 
+
+    // Readers first, so the writers never wait for them to start. A thread 
+    // that could not start would leave the others waiting forever. 
+    for (i = 0; i < dev_count * readers; i += 1)
+    {
+        r_threads[i].device = &(devices[i / readers]); 
+        r_threads[i].id = i; 
+        r_threads[i].last_seq = (uint64_t*)calloc(writers, sizeof(uint64_t)); 
+        if (!r_threads[i].last_seq || pthread_create(&(r_threads[i].thread), NULL, reader, &(r_threads[i])))
+        {
+            printf("~Can't start the reader threads.\n"); 
+            exit(-1); 
+        }
+    }
+
+    for (i = 0; i < dev_count * writers; i += 1)
+    {
+        w_threads[i].device = &(devices[i / writers]); 
+        w_threads[i].id = i; 
+        if (pthread_create(&(w_threads[i].thread), NULL, writer, &(w_threads[i])))
+        {
+            printf("~Can't start the writer threads.\n"); 
+            exit(-1); 
+        }
+    }
+
+    if (reset_ms && pthread_create(&reset_thread, NULL, resetter, NULL))
+    {
+        printf("~Can't start the reset thread.\n"); 
+        exit(-1); 
+    }
+
+    // Report the throughput of the last second as it runs. 
+    clock_gettime(CLOCK_MONOTONIC, &start); 
+    last_msgs = 0; 
+    last_bytes = 0; 
+    printf("%6s %12s %10s %10s %8s\n", "time", "msg/s", "MB/s", "resets", "errors"); 
+    for (elapsed = 0; elapsed < seconds; )
+    {
+        sleep(1); 
+        clock_gettime(CLOCK_MONOTONIC, &now); 
+        elapsed = now.tv_sec - start.tv_sec; 
+
+        msgs = __atomic_load_n(&(stats.msgs), __ATOMIC_RELAXED); 
+        bytes = __atomic_load_n(&(stats.bytes), __ATOMIC_RELAXED); 
+        printf(
+            "%5us %12llu %10.1f %10llu %8llu\n", elapsed,
+            (unsigned long long)(msgs - last_msgs), (bytes - last_bytes) / 1e6,
+            (unsigned long long)__atomic_load_n(&(stats.resets), __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&(stats.errors), __ATOMIC_RELAXED)
+        ); 
+
+        last_msgs = msgs; 
+        last_bytes = bytes; 
+    }
+
+    // Stop the resets and the writers, then let the readers drain what the 
+    // writers left. 
+    __atomic_store_n(&stop_writers, true, __ATOMIC_RELAXED); 
+    if (reset_ms)
+        pthread_join(reset_thread, NULL); 
+
+    for (i = 0; i < dev_count * writers; i += 1)
+        pthread_join(w_threads[i].thread, NULL); 
+
+    __atomic_store_n(&stop_readers, true, __ATOMIC_RELEASE); 
+    for (i = 0; i < dev_count * readers; i += 1)
+    {
+        pthread_join(r_threads[i].thread, NULL); 
+        free(r_threads[i].last_seq); 
+    }
+
+    // Without resets, every message sent must have been received once. 
+    for (i = 0; i < dev_count * writers && !reset_ms; i += 1)
+        if (stats.sent[i] != stats.received[i])
+            report_error(w_threads[i].device, "messages lost by a writer", (long long)(stats.sent[i] - stats.received[i])); 
+
+    for (d = 0; d < dev_count; d += 1)
+        restore_device(&(devices[d])); 
+
+    printf(
+        "~%llu message(s), %.1f MB in %u s, %llu reset(s), %llu error(s).\n",
+        (unsigned long long)stats.msgs, stats.bytes / 1e6, elapsed,
+        (unsigned long long)stats.resets, (unsigned long long)stats.errors
+    ); 
+
+    free(stats.sent); 
+    free(stats.received); 
+    free(w_threads); 
+    free(r_threads); 
+    free(devices); 
+    return stats.errors ? -1 : 0; 
+}
+
+
+/// FNV-1a hash of a message header, its sum excluded, and of its payload. 
+uint32_t checksum(const TORTURE_msg_t* msg, const unsigned char* payload)
+{
+    const unsigned char*    bytes; 
+    uint32_t                hash; 
+    size_t                  i; 
+
+    hash = 2166136261u; 
+    bytes = (const unsigned char*)msg; 
+    for (i = 0; i < offsetof(TORTURE_msg_t, sum); i += 1)
+        hash = (hash ^ bytes[i]) * 16777619u; 
+
+    for (i = 0; i < msg->len; i += 1)
+        hash = (hash ^ payload[i]) * 16777619u; 
+
+    return hash; 
+}
+
+
+/// xorshift32, enough to vary the payloads and their length. 
+uint32_t next_random(uint32_t* state)
+{
+    *state ^= *state << 13; 
+    *state ^= *state >> 17; 
+    *state ^= *state << 5; 
+    return *state; 
+}
+
+
+/// Count an error, and describe the first few of them. 
+void report_error(const TORTURE_device_t* device, const char* reason, long long value)
+{
+    if (__atomic_fetch_add(&(stats.errors), 1, __ATOMIC_RELAXED) < TORTURE_REPORTS)
+        printf("~%s: %s (%lld).\n", device->path, reason, value); 
+}
+
+
+/// Save the size and mode of a device, then switch it to record mode empty, 
+/// so every read returns a single message. 
+int setup_device(TORTURE_device_t* device)
+{
+    int mode; 
+    int fd; 
+
+    fd = open(device->path, O_RDWR); 
+    if (fd < 0)
+        return -1; 
+
+    if (ioctl(fd, IO_FIFO_GET_SIZE, &(device->old_size)) || ioctl(fd, IO_FIFO_GET_MODE, &(device->old_mode)))
+    {
+        close(fd); 
+        return -1; 
+    }
+
+    // A message must fit twice, so a writer never waits for the whole 
+    // buffer to be read. 
+    device->max_msg = device->old_size / 2 < TORTURE_MAX_MSG ? device->old_size / 2 : TORTURE_MAX_MSG; 
+    if (device->max_msg < sizeof(TORTURE_msg_t) + sizeof(unsigned int))
+    {
+        close(fd); 
+        return -1; 
+    }
+
+    device->max_msg -= sizeof(unsigned int); 
+    mode = FIFO_MODE_RECORD; 
+    ioctl(fd, IO_FIFO_RESET); 
+    if (ioctl(fd, IO_FIFO_SET_MODE, &mode))
+    {
+        close(fd); 
+        return -1; 
+    }
+
+    close(fd); 
+    return 0; 
+}
+
+
+void restore_device(TORTURE_device_t* device)
+{
+    int fd; 
+
+    fd = open(device->path, O_RDWR); 
+    if (fd < 0)
+        return; 
+
+    ioctl(fd, IO_FIFO_RESET); 
+    ioctl(fd, IO_FIFO_SET_SIZE, &(device->old_size)); 
+    ioctl(fd, IO_FIFO_SET_MODE, &(device->old_mode)); 
+    close(fd); 
+}
+
+
+/// Write messages of random length and content, numbered from 1, until 
+/// told to stop. Writes block while the device is full. 
+void* writer(void* arg)
+{
+    TORTURE_thread_t*   self; 
+    TORTURE_msg_t*      msg; 
+    unsigned char       buf[TORTURE_MAX_MSG]; 
+    uint32_t            state; 
+    uint32_t            i; 
+    ssize_t             len; 
+    int                 fd; 
+
+    self = arg; 
+    msg = (TORTURE_msg_t*)buf; 
+    fd = open(self->device->path, O_WRONLY); 
+    if (fd < 0)
+    {
+        report_error(self->device, "can't open for writing", -errno); 
+        return NULL; 
+    }
+
+    state = 2463534242u ^ (self->id * 2654435761u); 
+    msg->magic = TORTURE_MAGIC; 
+    msg->writer = self->id; 
+    msg->seq = 0; 
+    while (!__atomic_load_n(&stop_writers, __ATOMIC_RELAXED))
+    {
+        msg->seq += 1; 
+        msg->len = next_random(&state) % (self->device->max_msg - sizeof(TORTURE_msg_t) + 1); 
+        for (i = 0; i < msg->len; i += 1)
+            buf[sizeof(TORTURE_msg_t) + i] = (unsigned char)next_random(&state); 
+
+        msg->sum = checksum(msg, buf + sizeof(TORTURE_msg_t)); 
+
+        len = write(fd, buf, sizeof(TORTURE_msg_t) + msg->len); 
+        if (len != (ssize_t)(sizeof(TORTURE_msg_t) + msg->len))
+        {
+            report_error(self->device, "short or failed write", len < 0 ? -errno : len); 
+            break; 
+        }
+
+        __atomic_fetch_add(&(stats.sent[self->id]), 1, __ATOMIC_RELAXED); 
+    }
+
+    close(fd); 
+    return NULL; 
+}
+
+
+/// Read and check messages until told to stop and the device is empty. 
+/// Each writer's messages must come whole, intact, and in order: resets may 
+/// drop some, never reorder them. 
+void* reader(void* arg)
+{
+    TORTURE_thread_t*   self; 
+    TORTURE_msg_t*      msg; 
+    struct pollfd       pfd; 
+    unsigned char       buf[TORTURE_MAX_MSG]; 
+    unsigned int        index; 
+    ssize_t             len; 
+
+    self = arg; 
+    msg = (TORTURE_msg_t*)buf; 
+
+    // Read without blocking, a reader sleeping in read() would never see the 
+    // others took the last messages. 
+    pfd.fd = open(self->device->path, O_RDONLY | O_NONBLOCK); 
+    pfd.events = POLLIN; 
+    if (pfd.fd < 0)
+    {
+        report_error(self->device, "can't open for reading", -errno); 
+        return NULL; 
+    }
+
+    while (true)
+    {
+        len = read(pfd.fd, buf, sizeof(buf)); 
+        if (len < 0 && errno == EAGAIN)
+        {
+            if (__atomic_load_n(&stop_readers, __ATOMIC_ACQUIRE))
+                break; 
+
+            poll(&pfd, 1, TORTURE_POLL_MS); 
+            continue; 
+        }
+
+        if (len < 0)
+        {
+            report_error(self->device, "failed read", -errno); 
+            break; 
+        }
+
+        // A message must be whole, from a writer of this device, and match 
+        // its checksum. 
+        if ((size_t)len < sizeof(TORTURE_msg_t) || msg->magic != TORTURE_MAGIC)
+        {
+            report_error(self->device, "not a message", len); 
+            continue; 
+        }
+
+        index = msg->writer - self->device->first_writer; 
+        if (msg->len != len - sizeof(TORTURE_msg_t) || index >= writers)
+        {
+            report_error(self->device, "torn message or unknown writer", len); 
+            continue; 
+        }
+
+        if (msg->sum != checksum(msg, buf + sizeof(TORTURE_msg_t)))
+        {
+            report_error(self->device, "corrupted message", msg->seq); 
+            continue; 
+        }
+
+        if (msg->seq <= self->last_seq[index])
+            report_error(self->device, "message out of order", msg->seq); 
+
+        self->last_seq[index] = msg->seq; 
+        __atomic_fetch_add(&(stats.received[msg->writer]), 1, __ATOMIC_RELAXED); 
+        __atomic_fetch_add(&(stats.msgs), 1, __ATOMIC_RELAXED); 
+        __atomic_fetch_add(&(stats.bytes), len, __ATOMIC_RELAXED); 
+    }
+
+    close(pfd.fd); 
+    return NULL; 
+}
+
+
+/// Empty every device in turn, one every reset_ms, while they are in use. 
+void* resetter(void* arg)
+{
+    unsigned int    d; 
+    int             fd; 
+
+    (void)arg; 
+    d = 0; 
+    while (!__atomic_load_n(&stop_writers, __ATOMIC_RELAXED))
+    {
+        usleep(reset_ms * 1000); 
+
+        fd = open(devices[d].path, O_RDWR); 
+        if (fd < 0 || ioctl(fd, IO_FIFO_RESET))
+            report_error(&(devices[d]), "failed reset", -errno); 
+
+        else
+            __atomic_fetch_add(&(stats.resets), 1, __ATOMIC_RELAXED); 
+
+        if (fd >= 0)
+            close(fd); 
+
+        d = (d + 1) % dev_count; 
+    }
+
+    return NULL; 
+}